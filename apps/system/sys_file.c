@@ -8,54 +8,525 @@
 
 #include "app.h"
 #include "inode.h"
+#include "job.h"
 #include <string.h>
 
+#define PAGE_SIZE           4096
+#define BLOCKS_PER_PAGE     (PAGE_SIZE / BLOCK_SIZE)
+#define PAGE_ID_TO_ADDR(x)  ((char*)APPS_PAGES_BASE + x * PAGE_SIZE)
+#define CACHE_NBLOCKS       256 /* 128KB of disk blocks cached in memory */
+#define CACHE_WRITE_THROUGH 0   /* 0 means write-back                     */
+#define SYNC_PERIOD         (earth->platform == QEMU ? 10000000 : 100000000)
+#define MTIME               (CLINT_BASE + 0xBFF8)
+#define READAHEAD_NBLOCKS   8  /* blocks prefetched for a sequential reader */
+#define DENTRY_CACHE_SIZE   64 /* directory entries cached in memory       */
+#define PATH_CACHE_SIZE     16 /* resolved paths cached in memory          */
+#define WORKER_STACK_SIZE   (32 * 1024)
+#define RAMDISK_NPAGES      (FILE_SYS_DISK_SIZE / PAGE_SIZE)
+#define RAMDISK_WRITE_BACK  1  /* 0 means the RAM disk is lost at reboot   */
+
 int getsize(inode_intf bs, uint ino) { return FILE_SYS_DISK_SIZE / BLOCK_SIZE; }
 
 int setsize(inode_intf bs, uint ino, uint newsize) { FATAL("cannot set size"); }
 
-int read(inode_intf bs, uint ino, uint offset, block_t* block) {
-    earth->disk_read(FILE_SYS_DISK_START + offset, 1, block->bytes);
+/* GPID_FILE serves a request right away if the blocks it needs are cached.
+ * Otherwise, the request becomes a job for the worker, a thread with its own
+ * stack which waits for the disk without blocking GPID_FILE, so the requests
+ * hitting the cache do not wait behind the ones waiting for the disk; See
+ * library/file/job.c for the requests served while the worker runs a job. */
+struct job_queue jobs;
+
+struct {
+    uint context[14]; /* ra, sp and s0 .. s11 */
+    uint busy;        /* serving worker.job   */
+    uint waiting;     /* waiting for the disk */
+    struct job job;
+} worker;
+uint dispatcher_context[14];
+uint in_worker;   /* whether the worker is running                     */
+uint would_block; /* whether a request served right away needs the disk */
+uint fs_open;     /* whether the worker has opened the file system     */
+char worker_stack[WORKER_STACK_SIZE] __attribute__((aligned(16)));
+
+/* Save ra, sp and s0 .. s11 in from[] and load them from to[], so the call
+ * returns in the thread which saved to[] (or enters to[0] the first time). */
+__attribute__((naked)) static void ctx_switch(uint* from, uint* to) {
+    asm volatile("sw ra, 0(a0)\n"
+                 "sw sp, 4(a0)\n"
+                 "sw s0, 8(a0)\n"
+                 "sw s1, 12(a0)\n"
+                 "sw s2, 16(a0)\n"
+                 "sw s3, 20(a0)\n"
+                 "sw s4, 24(a0)\n"
+                 "sw s5, 28(a0)\n"
+                 "sw s6, 32(a0)\n"
+                 "sw s7, 36(a0)\n"
+                 "sw s8, 40(a0)\n"
+                 "sw s9, 44(a0)\n"
+                 "sw s10, 48(a0)\n"
+                 "sw s11, 52(a0)\n"
+                 "lw ra, 0(a1)\n"
+                 "lw sp, 4(a1)\n"
+                 "lw s0, 8(a1)\n"
+                 "lw s1, 12(a1)\n"
+                 "lw s2, 16(a1)\n"
+                 "lw s3, 20(a1)\n"
+                 "lw s4, 24(a1)\n"
+                 "lw s5, 28(a1)\n"
+                 "lw s6, 32(a1)\n"
+                 "lw s7, 36(a1)\n"
+                 "lw s8, 40(a1)\n"
+                 "lw s9, 44(a1)\n"
+                 "lw s10, 48(a1)\n"
+                 "lw s11, 52(a1)\n"
+                 "ret");
+}
+
+static void worker_yield() {
+    in_worker = 0;
+    ctx_switch(worker.context, dispatcher_context);
+}
+
+static void worker_resume() {
+    in_worker   = 1;
+    would_block = 0;
+    ctx_switch(dispatcher_context, worker.context);
+}
+
+/* The worker submits a disk request with grass->sys_disk_submit() and lets
+ * GPID_FILE run until the kernel replies that the disk has served it; The
+ * kernel serves the requests with disk_buf, a page which is not mapped to
+ * the address space of GPID_FILE. */
+static char* disk_buf;
+
+static int disk_io(uint type, uint offset, uint nblocks) {
+    if (!in_worker) {
+        would_block = 1;
+        return -1;
+    }
+
+    struct disk_request req = {.type     = type,
+                               .block_no = FILE_SYS_DISK_START + offset,
+                               .nblocks  = nblocks,
+                               .buf      = disk_buf};
+    grass->sys_disk_submit(&req);
+    worker.waiting = 1;
+    worker_yield();
+    return 0;
+}
+
+/* With RAMDISK=1 (see Makefile), the file system region of the disk is read
+ * into the pages of ramdisk[] at boot, and the blocks are read and written
+ * with memcpy; A sync writes the dirty pages back if RAMDISK_WRITE_BACK. */
+char* ramdisk[RAMDISK_NPAGES];
+char ramdisk_dirty[RAMDISK_NPAGES];
+
+void ramdisk_init() {
+    for (uint i = 0; i < RAMDISK_NPAGES; i++) {
+        ramdisk[i] = PAGE_ID_TO_ADDR(earth->mmu_alloc(MMU_NOZERO));
+        struct disk_request req = {
+            .type     = DISK_READ,
+            .block_no = FILE_SYS_DISK_START + i * BLOCKS_PER_PAGE,
+            .nblocks  = BLOCKS_PER_PAGE,
+            .buf      = ramdisk[i]};
+        grass->sys_disk(&req);
+    }
+}
+
+void ramdisk_copy(uint type, uint offset, uint nblocks, block_t* blocks) {
+    for (uint i = 0, n; i < nblocks; i += n) {
+        uint page_no = (offset + i) / BLOCKS_PER_PAGE;
+        uint first   = (offset + i) % BLOCKS_PER_PAGE;
+        n = (nblocks - i < BLOCKS_PER_PAGE - first) ? nblocks - i
+                                                    : BLOCKS_PER_PAGE - first;
+
+        char* addr = ramdisk[page_no] + first * BLOCK_SIZE;
+        if (type == DISK_READ) {
+            memcpy(blocks + i, addr, n * BLOCK_SIZE);
+        } else {
+            memcpy(addr, blocks + i, n * BLOCK_SIZE);
+            ramdisk_dirty[page_no] = 1;
+        }
+    }
+}
+
+int ramdisk_sync(inode_intf bs) {
+    for (uint i = 0; RAMDISK_WRITE_BACK && i < RAMDISK_NPAGES; i++) {
+        if (!ramdisk_dirty[i]) continue;
+        /* Clear the flag before copying the page, so that a write to the
+         * page while the worker waits for the disk marks it dirty again,
+         * and set it again if the write fails. */
+        ramdisk_dirty[i] = 0;
+        memcpy(disk_buf, ramdisk[i], PAGE_SIZE);
+        if (disk_io(DISK_WRITE, i * BLOCKS_PER_PAGE, BLOCKS_PER_PAGE) < 0) {
+            ramdisk_dirty[i] = 1;
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* A multi-block request takes one disk request for every page of blocks. */
+int readv(inode_intf bs, uint ino, uint offset, uint nblocks, block_t* blocks) {
+    if (RAMDISK) {
+        ramdisk_copy(DISK_READ, offset, nblocks, blocks);
+        return 0;
+    }
+
+    for (uint i = 0, n; i < nblocks; i += n) {
+        n = (nblocks - i < BLOCKS_PER_PAGE) ? nblocks - i : BLOCKS_PER_PAGE;
+        if (disk_io(DISK_READ, offset + i, n) < 0) return -1;
+        memcpy(blocks + i, disk_buf, n * BLOCK_SIZE);
+    }
+    return 0;
+}
+
+int writev(inode_intf bs, uint ino, uint offset, uint nblocks,
+           block_t* blocks) {
+    if (RAMDISK) {
+        ramdisk_copy(DISK_WRITE, offset, nblocks, blocks);
+        return 0;
+    }
+
+    for (uint i = 0, n; i < nblocks; i += n) {
+        n = (nblocks - i < BLOCKS_PER_PAGE) ? nblocks - i : BLOCKS_PER_PAGE;
+        memcpy(disk_buf, blocks + i, n * BLOCK_SIZE);
+        if (disk_io(DISK_WRITE, offset + i, n) < 0) return -1;
+    }
     return 0;
 }
 
+int read(inode_intf bs, uint ino, uint offset, block_t* block) {
+    return readv(bs, ino, offset, 1, block);
+}
+
 int write(inode_intf bs, uint ino, uint offset, block_t* block) {
-    earth->disk_write(FILE_SYS_DISK_START + offset, 1, block->bytes);
+    return writev(bs, ino, offset, 1, block);
+}
+
+int mmap_pages(inode_intf fs, int pid, struct file_request* req) {
+    /* Check the range before computing its end, which could wrap around. */
+    if (req->vaddr % PAGE_SIZE || req->vaddr < APPS_MMAP_BASE ||
+        req->vaddr >= APPS_MMAP_END || req->nblocks == 0 ||
+        req->nblocks > (APPS_MMAP_END - req->vaddr) / BLOCK_SIZE ||
+        req->offset + req->nblocks < req->offset)
+        return -1;
+    uint end = req->vaddr + req->nblocks * BLOCK_SIZE;
+
+    int size = fs->getsize(fs, req->ino);
+    if (size < 0) return -1;
+
+    /* Reject a range overlapping the pages already mapped to pid. */
+    uint first = req->vaddr / PAGE_SIZE;
+    for (uint v = first; v < (end + PAGE_SIZE - 1) / PAGE_SIZE; v++)
+        if (earth->mmu_mapped(pid, v)) return -1;
+
+    /* Map one page for every 8 blocks of the file to the address space of
+     * pid; The pages beyond the end of the file share the zero page. */
+    uint vpage_no = first;
+    for (uint off = req->offset; off < req->offset + req->nblocks;
+         off += BLOCKS_PER_PAGE, vpage_no++) {
+        if (off >= size) {
+            earth->mmu_map(pid, vpage_no, ZERO_PAGE_ID);
+            continue;
+        }
+
+        uint nblocks  = (size - off < BLOCKS_PER_PAGE) ? size - off
+                                                       : BLOCKS_PER_PAGE;
+        uint flag     = (nblocks == BLOCKS_PER_PAGE) ? MMU_NOZERO : MMU_ZERO;
+        uint ppage_id = earth->mmu_alloc(flag);
+        earth->mmu_map(pid, vpage_no, ppage_id);
+
+        char* page = PAGE_ID_TO_ADDR(ppage_id);
+        if (fs->readv(fs, req->ino, off, nblocks, (void*)page) < 0) {
+            /* Unmap and free the pages mapped so far. */
+            for (uint v = first; v <= vpage_no; v++) earth->mmu_unmap(pid, v);
+            return -1;
+        }
+    }
     return 0;
 }
 
+struct stream {
+    uint next; /* the offset of the next block if ino is read sequentially */
+    uint end;  /* blocks before this offset have been prefetched           */
+} streams[NINODES];
+
+/* The prefetched blocks only fill the block cache; prefetch() reads them
+ * into a static buffer of its caller (GPID_FILE or the worker) rather than
+ * onto the stack, which is 2 pages for GPID_FILE (see library/elf/elf.c). */
+block_t prefetch_bufs[2][READAHEAD_NBLOCKS];
+
+void prefetch(inode_intf fs, uint ino) {
+    struct stream* s = &streams[ino];
+    int size         = fs->getsize(fs, ino);
+    if (s->end < s->next) s->end = s->next;
+    uint end = s->next + READAHEAD_NBLOCKS;
+    if (size < 0 || s->end >= size) return;
+    if (end > size) end = size;
+
+    block_t* blocks = prefetch_bufs[in_worker];
+    if (fs->readv(fs, ino, s->end, end - s->end, blocks) == 0) s->end = end;
+}
+
+void readahead(inode_intf fs, uint ino, uint offset, uint nblocks) {
+    if (ino >= NINODES) return;
+    struct stream* s = &streams[ino];
+    uint sequential  = (offset == s->next);
+    s->next          = offset + nblocks;
+    if (!sequential) s->end = s->next;
+
+    /* Prefetch the next READAHEAD_NBLOCKS blocks into the block cache when
+     * half of the prefetched blocks have been read by a sequential reader;
+     * Leave it to the worker if the blocks are not cached. */
+    if (!sequential || s->end > s->next + READAHEAD_NBLOCKS / 2) return;
+
+    prefetch(fs, ino);
+    if (would_block && jobs.cnt < JOB_QUEUE_SIZE) {
+        struct file_request req = {.type = FILE_READ, .ino = ino};
+        job_push(&jobs, GPID_UNUSED, &req);
+    }
+    would_block = 0;
+}
+
+struct dentry {
+    uint dir_ino, ino;
+    char name[DIR_NAME_LEN]; /* unused if name[0] == 0 */
+} dentries[DENTRY_CACHE_SIZE];
+
+struct path_entry {
+    uint dir_ino, ino;
+    char path[FILE_PATH_LEN]; /* unused if path[0] == 0 */
+} paths[PATH_CACHE_SIZE];
+
+char is_dir[NINODES]; /* whether an inode has been read as a directory */
+
+int lookup(inode_intf fs, uint dir_ino, char* name) {
+    struct dentry* d =
+        &dentries[(dir_hash(name) + dir_ino) % DENTRY_CACHE_SIZE];
+    if (d->name[0] && d->dir_ino == dir_ino && strcmp(d->name, name) == 0)
+        return d->ino;
+
+    if (dir_ino < NINODES) is_dir[dir_ino] = 1;
+    int ino = dir_find(fs, dir_ino, name);
+    if (ino >= 0 && name[0]) {
+        d->dir_ino = dir_ino;
+        d->ino     = ino;
+        strcpy(d->name, name);
+    }
+    return ino;
+}
+
+int cache_path(struct path_entry* p, uint dir_ino, char* path, int ino) {
+    p->dir_ino = dir_ino;
+    p->ino     = ino;
+    strcpy(p->path, path);
+    return ino;
+}
+
+int lookup_path(inode_intf fs, uint dir_ino, char* path) {
+    struct path_entry* p =
+        &paths[(dir_hash(path) + dir_ino) % PATH_CACHE_SIZE];
+    if (p->path[0] && p->dir_ino == dir_ino && strcmp(p->path, path) == 0)
+        return p->ino;
+
+    int ino = dir_find_path(fs, dir_ino, path, lookup);
+    return (ino >= 0) ? cache_path(p, dir_ino, path, ino) : -1;
+}
+
+void lookup_invalidate(uint dir_ino) {
+    /* Forget the names in dir_ino and the resolved paths, which may go
+     * through dir_ino, when the directory is written. */
+    if (dir_ino >= NINODES || !is_dir[dir_ino]) return;
+    for (uint i = 0; i < DENTRY_CACHE_SIZE; i++)
+        if (dentries[i].dir_ino == dir_ino) dentries[i].name[0] = 0;
+    for (uint i = 0; i < PATH_CACHE_SIZE; i++) paths[i].path[0] = 0;
+}
+
+int read_range(inode_intf fs, uint ino, uint offset, uint nblocks,
+               struct file_reply* reply) {
+    /* Reply with at most FILE_READ_NBLOCKS blocks within the file. */
+    int size = fs->getsize(fs, ino);
+    if (size < 0) return -1;
+
+    if (nblocks > FILE_READ_NBLOCKS) nblocks = FILE_READ_NBLOCKS;
+    if (offset >= size) nblocks = 0;
+    if (nblocks > size - offset) nblocks = size - offset;
+    reply->nblocks = nblocks;
+    return nblocks ? fs->readv(fs, ino, offset, nblocks, reply->blocks) : 0;
+}
+
+/* Serve a request of sender and return 0, or return -1 if it is served
+ * right away and needs the disk, in which case nothing has been sent. */
+int serve(inode_intf fs, inode_intf cache, int sender,
+          struct file_request* req, struct file_reply* reply) {
+    int r;
+    switch (req->type) {
+    case FILE_READ:
+        r = fs->read(fs, req->ino, req->offset, reply->blocks);
+        if (would_block) return -1;
+        reply->status = r == 0 ? FILE_OK : FILE_ERROR;
+        grass->sys_send(sender, (void*)reply, sizeof(*reply));
+        if (r == 0) readahead(fs, req->ino, req->offset, 1);
+        break;
+    case FILE_READV:
+    case FILE_STREAM:
+        /* FILE_STREAM keeps replying until the range or the file ends,
+         * and the sender receives the replies one after another; req keeps
+         * the rest of the range for the worker if a reply needs the disk. */
+        for (uint start = req->offset;; req->offset += reply->nblocks) {
+            r = read_range(fs, req->ino, req->offset, req->nblocks, reply);
+            if (would_block) return -1;
+            reply->status = r == 0 ? FILE_OK : FILE_ERROR;
+            grass->sys_send(sender, (void*)reply, sizeof(*reply));
+            if (r < 0) break;
+
+            req->nblocks -= reply->nblocks;
+            if (req->type == FILE_READV || req->nblocks == 0 ||
+                reply->nblocks < FILE_READ_NBLOCKS) {
+                readahead(fs, req->ino, start,
+                          req->offset + reply->nblocks - start);
+                break;
+            }
+        }
+        break;
+    case FILE_MMAP:
+        r             = mmap_pages(fs, sender, req);
+        reply->status = r == 0 ? FILE_OK : FILE_ERROR;
+        grass->sys_send(sender, (void*)reply, sizeof(*reply));
+        break;
+    case FILE_STATS:
+        cachedisk_get_stats(cache, &reply->stats);
+        reply->status = FILE_OK;
+        grass->sys_send(sender, (void*)reply, sizeof(*reply));
+        break;
+    case FILE_LOOKUP:
+        req->path[DIR_NAME_LEN - 1] = 0;
+
+        r = lookup(fs, req->ino, req->path);
+        if (would_block) return -1;
+        reply->ino    = r;
+        reply->status = r >= 0 ? FILE_OK : FILE_ERROR;
+        grass->sys_send(sender, (void*)reply, sizeof(*reply));
+        break;
+    case FILE_LOOKUP_PATH:
+        req->path[FILE_PATH_LEN - 1] = 0;
+
+        r = lookup_path(fs, req->ino, req->path);
+        if (would_block) return -1;
+        reply->ino    = r;
+        reply->status = r >= 0 ? FILE_OK : FILE_ERROR;
+        grass->sys_send(sender, (void*)reply, sizeof(*reply));
+        break;
+    case FILE_WRITE:
+        lookup_invalidate(req->ino);
+        r             = fs->write(fs, req->ino, req->offset, &req->block);
+        reply->status = r == 0 ? FILE_OK : FILE_ERROR;
+        grass->sys_send(sender, (void*)reply, sizeof(*reply));
+        break;
+    case FILE_SYNC:
+        r             = fs->sync(fs);
+        reply->status = r == 0 ? FILE_OK : FILE_ERROR;
+        grass->sys_send(sender, (void*)reply, sizeof(*reply));
+        break;
+    default:
+        FATAL("sys_file: invalid request %d", req->type);
+    }
+    return 0;
+}
+
+int serve_now(struct file_request* req) {
+    return fs_open && job_serve_now(req, worker.busy ? &worker.job : NULL);
+}
+
+/* The messages (SYSCALL_MSG_LEN bytes) and replies are static, leaving the
+ * 2 stack pages of GPID_FILE to the file system layers. */
+inode_intf fs, cache;
+struct file_reply worker_reply;
+
+void worker_main() {
+    /* Open the file system, which replays the log of treedisk, and read the
+     * root directory before any request is served. */
+    fs->read(fs, 0, 0, &worker_reply.blocks[0]);
+    fs_open = 1;
+
+    for (;;) {
+        while (job_pop(&jobs, &worker.job) < 0) worker_yield();
+        worker.busy = 1;
+
+        /* The jobs of GPID_FILE itself are prefetches and periodic syncs. */
+        struct file_request* req = &worker.job.req;
+        if (worker.job.sender != GPID_UNUSED)
+            serve(fs, cache, worker.job.sender, req, &worker_reply);
+        else if (req->type == FILE_SYNC)
+            fs->sync(fs);
+        else
+            prefetch(fs, req->ino);
+        worker.busy = 0;
+    }
+}
+
 int main() {
     SUCCESS("Enter kernel process GPID_FILE");
 
     /* Initialize the file system interface. */
-    struct inode_store disk = (struct inode_store){
-        .read = read, .write = write, .getsize = getsize, .setsize = setsize};
+    disk_buf = PAGE_ID_TO_ADDR(earth->mmu_alloc(MMU_NOZERO));
+    if (RAMDISK) ramdisk_init();
+    struct inode_store disk =
+        (struct inode_store){.read    = read,
+                             .write   = write,
+                             .readv   = readv,
+                             .writev  = writev,
+                             .getsize = getsize,
+                             .setsize = setsize,
+                             .sync    = RAMDISK ? ramdisk_sync : NULL};
 
-    inode_intf fs =
-        (FILESYS == 0) ? mydisk_init(&disk, 0) : treedisk_init(&disk, 0);
+    cache = cachedisk_init(&disk, CACHE_NBLOCKS, CACHE_WRITE_THROUGH);
+    fs    = (FILESYS == 0) ? mydisk_init(cache, 0) : treedisk_init(cache, 0);
+
+    /* Start the worker, which enters worker_main() on its own stack. */
+    worker.context[0] = (uint)worker_main;
+    worker.context[1] = (uint)(worker_stack + WORKER_STACK_SIZE);
+    worker_resume();
 
     /* Send a notification to GPID_PROCESS. */
-    char buf[SYSCALL_MSG_LEN];
+    static char buf[SYSCALL_MSG_LEN];
     strcpy(buf, "Finish GPID_FILE initialization");
     grass->sys_send(GPID_PROCESS, buf, 32);
 
-    /* Wait for inode read or write requests. */
-    while (1) {
-        int sender, r;
+    /* Wait for inode read or write requests, and for the disk requests of
+     * the worker, which the kernel replies to from GPID_UNUSED; The kernel
+     * also sends a tick from GPID_UNUSED about once per second, which is a
+     * zeroed disk request. */
+    for (uint last_sync = REGW(MTIME, 0);;) {
+        if (!worker.waiting && jobs.cnt > 0) worker_resume();
+
+        int sender;
         struct file_request* req = (void*)buf;
-        struct file_reply* reply = (void*)buf;
-        grass->sys_recv(GPID_ALL, &sender, buf, SYSCALL_MSG_LEN);
+        static struct file_reply reply;
+        grass->sys_recv(jobs.cnt == JOB_QUEUE_SIZE ? GPID_UNUSED : GPID_ALL,
+                        &sender, buf, SYSCALL_MSG_LEN);
 
-        switch (req->type) {
-        case FILE_READ:
-            r = fs->read(fs, req->ino, req->offset, (void*)&reply->block);
-            reply->status = r == 0 ? FILE_OK : FILE_ERROR;
-            grass->sys_send(sender, (void*)reply, sizeof(*reply));
-            break;
-        case FILE_WRITE:
-            /* The FILE_WRITE case is left to students as an exercise. */
-        default:
-            FATAL("sys_file: invalid request %d", req->type);
+        if (sender == GPID_UNUSED) {
+            if (((struct disk_request*)buf)->status == DISK_DONE) {
+                worker.waiting = 0;
+                worker_resume();
+            }
+        } else {
+            would_block = 0;
+            if (!serve_now(req) || serve(fs, cache, sender, req, &reply) < 0)
+                job_push(&jobs, sender, req);
+            if (req->type == FILE_SYNC) last_sync = REGW(MTIME, 0);
+        }
+
+        /* Commit the file system log and write back the dirty blocks about
+         * once per second (SYNC_PERIOD is in mtime ticks), which is checked
+         * after receiving every message, including the ticks. */
+        if (REGW(MTIME, 0) - last_sync >= SYNC_PERIOD &&
+            jobs.cnt < JOB_QUEUE_SIZE) {
+            struct file_request sync = {.type = FILE_SYNC};
+            job_push(&jobs, GPID_UNUSED, &sync);
+            last_sync = REGW(MTIME, 0);
         }
     }
 }
@@ -11,9 +11,20 @@
 #include "disk.h"
 #include <string.h>
 
+#define PAGE_SIZE          4096
+#define BLOCKS_PER_PAGE    (PAGE_SIZE / BLOCK_SIZE)
+#define PAGE_ID_TO_ADDR(x) ((char*)APPS_PAGES_BASE + x * PAGE_SIZE)
+#define PRELOAD_BIN        1   /* 0 means every spawn reads from GPID_FILE */
+#define EXEC_CACHE_NPAGES  128 /* 512KB of executables kept in memory     */
+#define EXEC_CACHE_NFILES  32
+#define MTIME              (CLINT_BASE + 0xBFF8)
+#define MTIME_PER_US       (earth->platform == QEMU ? 10 : 100)
+#define REPORT_LOAD_TIME   0   /* 1 prints the load time of every spawn    */
+
 static int app_ino, app_pid;
 static void sys_spawn(uint base);
 static int app_spawn(struct proc_request* req);
+static void exec_cache_load();
 
 struct multicore {
     int boot_lock, booted_core_cnt; /* See earth/boot.s */
@@ -39,6 +50,7 @@ int main(int unused, struct multicore* boot) {
     sys_spawn(SYS_FILE_EXEC_START);
     grass->sys_recv(GPID_FILE, NULL, buf, SYSCALL_MSG_LEN);
     INFO("sys_process receives: %s", buf);
+    if (PRELOAD_BIN) exec_cache_load();
 
     sys_spawn(SYS_SHELL_EXEC_START);
 
@@ -79,16 +91,96 @@ int main(int unused, struct multicore* boot) {
     }
 }
 
-static void app_read(uint off, char* dst) { file_read(app_ino, off, dst); }
+/* exec_cache_load() reads the executables in /bin into memory at boot, each
+ * starting at a page of exec_pages[]; A spawn of a cached executable copies
+ * its blocks from memory, which assumes /bin is not written after boot. */
+static struct exec_file {
+    int ino;
+    uint first_page, nblocks;
+} exec_files[EXEC_CACHE_NFILES], *exec_file;
+static uint exec_nfiles, exec_npages;
+static char* exec_pages[EXEC_CACHE_NPAGES];
+
+static void exec_cache_add(int ino) {
+    struct exec_file* f = &exec_files[exec_nfiles];
+    f->ino              = ino;
+    f->first_page       = exec_npages;
+    f->nblocks          = 0;
+
+    for (int n = BLOCKS_PER_PAGE; n == BLOCKS_PER_PAGE;) {
+        /* Skip a file which does not fit, leaving its pages to the next. */
+        if (exec_npages == EXEC_CACHE_NPAGES) {
+            exec_npages = f->first_page;
+            return;
+        }
+        if (exec_pages[exec_npages] == NULL)
+            exec_pages[exec_npages] =
+                PAGE_ID_TO_ADDR(earth->mmu_alloc(MMU_NOZERO));
+
+        n = file_stream(ino, f->nblocks, BLOCKS_PER_PAGE,
+                        exec_pages[exec_npages]);
+        if (n < 0) {
+            exec_npages = f->first_page;
+            return;
+        }
+        if (n > 0) exec_npages++;
+        f->nblocks += n;
+    }
+    exec_nfiles++;
+}
+
+static void exec_cache_load() {
+    int bin_ino = path_lookup(0, "/bin");
+    struct dir_block blocks[FILE_READ_NBLOCKS];
+    for (uint off = 0; bin_ino >= 0; off += FILE_READ_NBLOCKS) {
+        int n = file_readv(bin_ino, off, FILE_READ_NBLOCKS, (void*)blocks);
+        for (uint i = 0; n > 0 && i < n * DIR_ENTRIES_PER_BLOCK; i++) {
+            struct dir_entry* e = &blocks[i / DIR_ENTRIES_PER_BLOCK]
+                                       .entries[i % DIR_ENTRIES_PER_BLOCK];
+            if (e->name[0] && e->name[strlen(e->name) - 1] != '/' &&
+                exec_nfiles < EXEC_CACHE_NFILES)
+                exec_cache_add(e->ino);
+        }
+        if (n < FILE_READ_NBLOCKS) break;
+    }
+    INFO("Preload %d executables in /bin (%d pages)", exec_nfiles,
+         exec_npages);
+}
+
+/* elf_load() reads up to a page of blocks with one call, so app_read()
+ * fetches them with one file_stream() request, or copies them from memory
+ * if the executable has been preloaded. */
+static void app_read(uint off, uint nblocks, char* dst) {
+    if (exec_file == NULL) {
+        file_stream(app_ino, off, nblocks, dst);
+        return;
+    }
+
+    for (uint i = off; i < off + nblocks && i < exec_file->nblocks; i++) {
+        char* page = exec_pages[exec_file->first_page + i / BLOCKS_PER_PAGE];
+        memcpy(dst + (i - off) * BLOCK_SIZE,
+               page + (i % BLOCKS_PER_PAGE) * BLOCK_SIZE, BLOCK_SIZE);
+    }
+}
 
 static int app_spawn(struct proc_request* req) {
-    int bin_ino = dir_lookup(0, "bin/");
-    if ((app_ino = dir_lookup(bin_ino, req->argv[0])) < 0) return CMD_ERROR;
+    char path[CMD_ARG_LEN + 8] = "/bin/";
+    strcat(path, req->argv[0]);
+    if ((app_ino = path_lookup(0, path)) < 0) return CMD_ERROR;
     int argc = req->argv[req->argc - 1][0] == '&' ? req->argc - 1 : req->argc;
 
-    app_pid = grass->proc_alloc();
+    exec_file = NULL;
+    for (uint i = 0; i < exec_nfiles; i++)
+        if (exec_files[i].ino == app_ino) exec_file = &exec_files[i];
+
+    uint start = REGW(MTIME, 0);
+    app_pid    = grass->proc_alloc();
     elf_load(app_pid, app_read, argc, (void**)req->argv);
     grass->proc_set_ready(app_pid);
+    if (REPORT_LOAD_TIME)
+        INFO("Load %s in %d us%s", req->argv[0],
+             (REGW(MTIME, 0) - start) / MTIME_PER_US,
+             exec_file ? " (preloaded)" : "");
 
     return CMD_OK;
 }
@@ -96,8 +188,8 @@ static int app_spawn(struct proc_request* req) {
 static int sys_apps_base;
 char* sys_apps[] = {"sys_process", "sys_terminal", "sys_file", "sys_shell"};
 
-static void sys_proc_read(uint block_no, char* dst) {
-    earth->disk_read(sys_apps_base + block_no, 1, dst);
+static void sys_proc_read(uint block_no, uint nblocks, char* dst) {
+    earth->disk_read(sys_apps_base + block_no, nblocks, dst);
 }
 
 static void sys_spawn(uint base) {
@@ -0,0 +1,22 @@
+/*
+ * (C) 2025, Cornell University
+ * All rights reserved.
+ *
+ * Description: print the statistics of the block cache in GPID_FILE
+ */
+
+#include "app.h"
+
+int main() {
+    struct cache_stats stats;
+    if (file_stats(&stats) < 0) {
+        INFO("cachestat: fail to get the statistics");
+        return -1;
+    }
+
+    printf("block cache: %d blocks, %d hits, %d misses, %d evictions\n\r",
+           stats.nblocks, stats.nhits, stats.nmisses, stats.nevicts);
+    printf("block cache: %d blocks written, %d blocks written to disk\n\r",
+           stats.nwrites, stats.nwritebacks);
+    return 0;
+}
@@ -8,6 +8,10 @@
 #include "app.h"
 #include <string.h>
 
+#define CAT_NBLOCKS 8 /* blocks read with one file_stream() */
+
+static char buf[CAT_NBLOCKS * BLOCK_SIZE + 1];
+
 int main(int argc, char** argv) {
     if (argc != 2) {
         INFO("usage: cat [FILE]");
@@ -15,17 +19,29 @@ int main(int argc, char** argv) {
     }
 
     /* Get the inode number of the file. */
-    int file_ino = dir_lookup(workdir_ino, argv[1]);
+    int file_ino = path_lookup(workdir_ino, argv[1]);
     if (file_ino < 0) {
         INFO("cat: file %s not found", argv[1]);
         return -1;
     }
 
-    /* Read and print the first block of the inode. */
-    char buf[BLOCK_SIZE];
-    file_read(file_ino, 0, buf);
-    printf("%s", buf);
-    if (buf[strlen(buf) - 1] != '\n') printf("\n\r");
+    /* Read and print the file until the end or a null character. */
+    char last = '\n';
+    for (uint off = 0;; off += CAT_NBLOCKS) {
+        int nblocks = file_stream(file_ino, off, CAT_NBLOCKS, buf);
+        if (nblocks <= 0) break;
+
+        buf[nblocks * BLOCK_SIZE] = 0;
+        uint len                  = strlen(buf);
+        if (len) last = buf[len - 1];
+
+        /* printf() has a 512-byte buffer, so use term_write() instead. */
+        for (uint i = 0; i < len; i += TERM_BUF_SIZE)
+            term_write(buf + i, (len - i < TERM_BUF_SIZE) ? len - i
+                                                          : TERM_BUF_SIZE);
+        if (len < nblocks * BLOCK_SIZE || nblocks < CAT_NBLOCKS) break;
+    }
+    if (last != '\n') printf("\n\r");
 
     return 0;
 }
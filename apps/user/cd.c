@@ -10,15 +10,14 @@
 
 int main(int argc, char** argv) {
     if (argc == 1) {
-        int home_ino = dir_lookup(0, "home/");
-        workdir_ino  = dir_lookup(home_ino, "yunhao/");
+        workdir_ino = path_lookup(0, "/home/yunhao/");
         strcpy(workdir, "/home/yunhao");
         return 0;
     }
 
     /* Set the inode number to the new working directory. */
     if (argv[1][strlen(argv[1]) - 1] != '/') strcat(argv[1], "/");
-    int dir_ino = dir_lookup(workdir_ino, argv[1]);
+    int dir_ino = path_lookup(workdir_ino, argv[1]);
     if (dir_ino == -1) {
         INFO("cd: directory %s not found", argv[1]);
         return -1;
@@ -26,15 +25,18 @@ int main(int argc, char** argv) {
     workdir_ino = dir_ino;
 
     /* Set the path name to the new working directory. */
-    if (strcmp("./", argv[1]) == 0) return 0;
-
-    uint len = strlen(workdir);
-    if (strcmp("../", argv[1]) == 0) {
-        while (workdir[len] != '/') workdir[len--] = 0;
-        if (len) workdir[len] = 0;
-    } else {
-        if (len > 1) strcat(workdir, "/");
-        strncat(workdir, argv[1], strlen(argv[1]) - 1);
+    if (argv[1][0] == '/') strcpy(workdir, "/");
+    for (char* name = argv[1]; *name;) {
+        uint len = strcspn(name, "/");
+        if (len == 2 && strncmp(name, "..", 2) == 0) {
+            char* slash                           = strrchr(workdir, '/');
+            *(slash == workdir ? slash + 1 : slash) = 0;
+        } else if (len > 0 && !(len == 1 && name[0] == '.')) {
+            if (strlen(workdir) > 1) strcat(workdir, "/");
+            strncat(workdir, name, len);
+        }
+        name += len;
+        if (*name == '/') name++;
     }
 
     return 0;
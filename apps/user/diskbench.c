@@ -0,0 +1,71 @@
+/*
+ * (C) 2025, Cornell University
+ * All rights reserved.
+ *
+ * Description: a benchmark for the disk device driver
+ * Measure sequential and random block throughput of earth->disk_read() and
+ * earth->disk_write() on the region of the disk with the EGOS binaries. The
+ * write tests write back the blocks just read, keeping the disk intact. The
+ * file system region is not used: GPID_FILE writes its cached blocks back in
+ * the background, and a block written back here could overwrite them.
+ */
+
+#include "app.h"
+#include "disk.h"
+#include <stdlib.h>
+
+#define NBLOCKS   256 /* 128KB for each test */
+#define MAX_BATCH 64
+#define MTIME     (CLINT_BASE + 0xBFF8)
+#define MTIME_HZ  (earth->platform == QEMU ? 10000000 : 100000000)
+
+static char buf[MAX_BATCH * BLOCK_SIZE];
+
+static uint random_block_no() {
+    return rand() % (EGOS_BIN_DISK_SIZE / BLOCK_SIZE);
+}
+
+static void report(char* name, uint batch, uint ticks) {
+    ulonglong bytes = (ulonglong)NBLOCKS * BLOCK_SIZE * MTIME_HZ;
+    printf("%s (%d blocks per call): %d ticks, %d KB/s\n\r", name, batch,
+           ticks, (uint)(bytes / (ticks ? ticks : 1) / 1024));
+}
+
+static void bench_sequential(uint batch) {
+    uint start = REGW(MTIME, 0);
+    for (uint i = 0; i < NBLOCKS; i += batch)
+        earth->disk_read(i, batch, buf);
+    report("sequential read", batch, REGW(MTIME, 0) - start);
+
+    start = REGW(MTIME, 0);
+    for (uint i = 0; i < NBLOCKS; i += batch) {
+        earth->disk_read(i, batch, buf);
+        earth->disk_write(i, batch, buf);
+    }
+    report("sequential read+write", batch, REGW(MTIME, 0) - start);
+}
+
+static void bench_random() {
+    srand(2000);
+    uint start = REGW(MTIME, 0);
+    for (uint i = 0; i < NBLOCKS; i++)
+        earth->disk_read(random_block_no(), 1, buf);
+    report("random read", 1, REGW(MTIME, 0) - start);
+
+    start = REGW(MTIME, 0);
+    for (uint i = 0; i < NBLOCKS; i++) {
+        uint block_no = random_block_no();
+        earth->disk_read(block_no, 1, buf);
+        earth->disk_write(block_no, 1, buf);
+    }
+    report("random read+write", 1, REGW(MTIME, 0) - start);
+}
+
+int main() {
+    INFO("diskbench: %d blocks per test, 1 tick = 1/%d second", NBLOCKS,
+         MTIME_HZ);
+    for (uint batch = 1; batch <= MAX_BATCH; batch *= 8)
+        bench_sequential(batch);
+    bench_random();
+    return 0;
+}
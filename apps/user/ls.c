@@ -14,15 +14,17 @@ int main(int argc, char** argv) {
         return -1;
     }
 
-    /* Read the directory content. */
-    char buf[BLOCK_SIZE];
-    file_read(workdir_ino, 0, buf);
-
-    /* Remove the inode numbers from the string. */
-    for (uint i = 1; i < strlen(buf); i++)
-        if (buf[i - 1] == ' ' && buf[i] >= '0' && buf[i] <= '9') buf[i] = ' ';
-
-    /* Print out the directory content. */
-    printf("%s\n\r", buf);
+    /* Read the directory blocks and print out the names in the entries. */
+    struct dir_block blocks[FILE_READ_NBLOCKS];
+    for (uint off = 0;; off += FILE_READ_NBLOCKS) {
+        int n = file_readv(workdir_ino, off, FILE_READ_NBLOCKS, (void*)blocks);
+        for (uint i = 0; n > 0 && i < n * DIR_ENTRIES_PER_BLOCK; i++) {
+            struct dir_entry* e = &blocks[i / DIR_ENTRIES_PER_BLOCK]
+                                       .entries[i % DIR_ENTRIES_PER_BLOCK];
+            if (e->name[0]) printf("%s ", e->name);
+        }
+        if (n < FILE_READ_NBLOCKS) break;
+    }
+    printf("\n\r");
     return 0;
 }
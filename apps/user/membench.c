@@ -0,0 +1,92 @@
+/*
+ * (C) 2025, Cornell University
+ * All rights reserved.
+ *
+ * Description: a benchmark for memcpy() and memset()
+ * Compare library/libc/string.s with the generic C versions of the C library
+ * (the algorithm of newlib/libc/string/mem{cpy,set}.c compiled with -O2).
+ * The mcycle CSR is read in machine mode, so use the software TLB to run it.
+ */
+
+#include "app.h"
+#include "syscall.h"
+#include <string.h>
+
+#define NROUNDS 100
+#define OPT     __attribute__((optimize("O2", "no-tree-loop-distribute-patterns")))
+
+static char src[4096 + 8] __attribute__((aligned(4096)));
+static char dst[4096 + 8] __attribute__((aligned(4096)));
+
+OPT static void* libc_memcpy(void* dst0, const void* src0, uint len) {
+    char* dst       = dst0;
+    const char* src = src0;
+    if (len >= 16 && !(((uint)src | (uint)dst) & 3)) {
+        uint* aligned_dst       = (uint*)dst;
+        const uint* aligned_src = (const uint*)src;
+        for (; len >= 16; len -= 16) {
+            *aligned_dst++ = *aligned_src++;
+            *aligned_dst++ = *aligned_src++;
+            *aligned_dst++ = *aligned_src++;
+            *aligned_dst++ = *aligned_src++;
+        }
+        for (; len >= 4; len -= 4) *aligned_dst++ = *aligned_src++;
+        dst = (char*)aligned_dst;
+        src = (const char*)aligned_src;
+    }
+    while (len--) *dst++ = *src++;
+    return dst0;
+}
+
+OPT static void* libc_memset(void* m, int c, uint n) {
+    char* s = m;
+    while ((uint)s & 3) {
+        if (n-- == 0) return m;
+        *s++ = (char)c;
+    }
+    if (n >= 4) {
+        uint buffer        = (c & 0xFF) * 0x01010101;
+        uint* aligned_addr = (uint*)s;
+        for (; n >= 16; n -= 16) {
+            *aligned_addr++ = buffer;
+            *aligned_addr++ = buffer;
+            *aligned_addr++ = buffer;
+            *aligned_addr++ = buffer;
+        }
+        for (; n >= 4; n -= 4) *aligned_addr++ = buffer;
+        s = (char*)aligned_addr;
+    }
+    while (n--) *s++ = (char)c;
+    return m;
+}
+
+static uint mcycle() {
+    uint cycle;
+    asm volatile("csrr %0, mcycle" : "=r"(cycle));
+    return cycle;
+}
+
+#define MEASURE(stmt)                                                          \
+    ({                                                                         \
+        uint start = mcycle();                                                 \
+        for (uint i = 0; i < NROUNDS; i++) stmt;                               \
+        (mcycle() - start) / NROUNDS;                                          \
+    })
+
+static void bench(char* name, uint off, uint len) {
+    uint cpy  = MEASURE(memcpy(dst + off, src, len));
+    uint cpy0 = MEASURE(libc_memcpy(dst + off, src, len));
+    uint set  = MEASURE(memset(dst + off, 0, len));
+    uint set0 = MEASURE(libc_memset(dst + off, 0, len));
+    printf("%s (%d bytes): memcpy %d vs. %d, memset %d vs. %d cycles\n\r", name,
+           len, cpy, cpy0, set, set0);
+}
+
+int main() {
+    INFO("membench: string.s vs. generic C library (cycles per call)");
+    bench("page", 0, 4096);
+    bench("syscall", 0, sizeof(struct syscall));
+    bench("registers", 0, 128);
+    bench("unaligned", 1, 1000);
+    return 0;
+}
@@ -0,0 +1,16 @@
+/*
+ * (C) 2025, Cornell University
+ * All rights reserved.
+ *
+ * Description: write the blocks cached by the file system back to the disk
+ */
+
+#include "app.h"
+
+int main() {
+    if (file_sync() < 0) {
+        INFO("sync: fail to write back the cached blocks");
+        return -1;
+    }
+    return 0;
+}
@@ -14,18 +14,51 @@
 #define PAGE_NO_TO_ADDR(x) (char*)(x * PAGE_SIZE)
 #define PAGE_ID_TO_ADDR(x) ((char*)APPS_PAGES_BASE + x * PAGE_SIZE)
 #define APPS_PAGES_CNT     (RAM_END - APPS_PAGES_BASE) / PAGE_SIZE
+#define ZERO_POOL_SIZE     64  /* at most 256KB of free pages kept zeroed */
+#define ZERO_MAP_CNT       512 /* at most 512 pages mapped to the zero page */
 
 struct page_info {
     int use;
+    int zeroed; /* a free page which has been zeroed by mmu_prezero() */
     int pid;
     uint vpage_no;
-} page_info_table[APPS_PAGES_CNT];
+} page_info_table[APPS_PAGES_CNT], zero_map_table[ZERO_MAP_CNT];
+/* zero_map_table records the pages mapped to ZERO_PAGE_ID (see egos.h). */
 
-uint mmu_alloc() {
-    for (uint i = 0; i < APPS_PAGES_CNT; i++)
-        if (!page_info_table[i].use) {
-            page_info_table[i].use = 1;
-            return i;
+static uint zero_pool_cnt;
+
+static int page_claim(struct page_info* page) {
+    /* The kernel may allocate pages while interrupting an mmu_alloc() of a
+     * system process (see soft_tlb_switch), so claim a page atomically. */
+    return !page->use && __sync_lock_test_and_set(&page->use, 1) == 0;
+}
+
+static void page_release(struct page_info* page) {
+    /* A page in use is never zeroed; Clear the other fields before use, so
+     * an mmu_prezero() interrupting this sees either a used page or a free
+     * page with every field cleared. */
+    page->pid      = 0;
+    page->vpage_no = 0;
+    __sync_lock_release(&page->use);
+}
+
+uint mmu_alloc(uint flag) {
+    /* Use a zeroed page only if the caller needs one and the pool is not
+     * empty; Otherwise, keep the zeroed pages for the later callers. */
+    uint want_zeroed = (flag == MMU_ZERO && zero_pool_cnt > 0);
+
+    for (uint any = 0; any < 2; any++)
+        for (uint i = 0; i < APPS_PAGES_CNT; i++) {
+            struct page_info* page = &page_info_table[i];
+            if ((any || page->zeroed == want_zeroed) && page_claim(page)) {
+                if (page->zeroed) {
+                    __sync_fetch_and_sub(&zero_pool_cnt, 1);
+                    page->zeroed = 0;
+                } else if (flag == MMU_ZERO) {
+                    memset(PAGE_ID_TO_ADDR(i), 0, PAGE_SIZE);
+                }
+                return i;
+            }
         }
     FATAL("mmu_alloc: no more free memory");
 }
@@ -33,14 +66,73 @@ uint mmu_alloc() {
 void mmu_free(int pid) {
     for (uint i = 0; i < APPS_PAGES_CNT; i++)
         if (page_info_table[i].use && page_info_table[i].pid == pid)
-            memset(&page_info_table[i], 0, sizeof(struct page_info));
+            page_release(&page_info_table[i]);
+
+    for (uint i = 0; i < ZERO_MAP_CNT; i++)
+        if (zero_map_table[i].use && zero_map_table[i].pid == pid)
+            page_release(&zero_map_table[i]);
+}
+
+void mmu_unmap(int pid, uint vpage_no) {
+    /* Unmap vpage_no of pid and free its page (see mmu_free). */
+    for (uint i = 0; i < APPS_PAGES_CNT; i++)
+        if (page_info_table[i].use && page_info_table[i].pid == pid &&
+            page_info_table[i].vpage_no == vpage_no)
+            page_release(&page_info_table[i]);
+
+    for (uint i = 0; i < ZERO_MAP_CNT; i++)
+        if (zero_map_table[i].use && zero_map_table[i].pid == pid &&
+            zero_map_table[i].vpage_no == vpage_no)
+            page_release(&zero_map_table[i]);
+}
+
+uint mmu_mapped(int pid, uint vpage_no) {
+    for (uint i = 0; i < APPS_PAGES_CNT; i++)
+        if (page_info_table[i].use && page_info_table[i].pid == pid &&
+            page_info_table[i].vpage_no == vpage_no)
+            return 1;
+
+    for (uint i = 0; i < ZERO_MAP_CNT; i++)
+        if (zero_map_table[i].use && zero_map_table[i].pid == pid &&
+            zero_map_table[i].vpage_no == vpage_no)
+            return 1;
+    return 0;
+}
+
+void mmu_prezero(uint npages) {
+    /* The kernel calls mmu_prezero() on timer interrupts. */
+    for (uint i = 0; i < APPS_PAGES_CNT && npages; i++) {
+        if (zero_pool_cnt >= ZERO_POOL_SIZE) return;
+        if (!page_info_table[i].use && !page_info_table[i].zeroed) {
+            memset(PAGE_ID_TO_ADDR(i), 0, PAGE_SIZE);
+            page_info_table[i].zeroed = 1;
+            zero_pool_cnt++;
+            npages--;
+        }
+    }
 }
 
 void soft_tlb_map(int pid, uint vpage_no, uint ppage_id) {
+    if (ppage_id == ZERO_PAGE_ID) {
+        for (uint i = 0; i < ZERO_MAP_CNT; i++)
+            if (page_claim(&zero_map_table[i])) {
+                zero_map_table[i].vpage_no = vpage_no;
+                zero_map_table[i].pid      = pid;
+                return;
+            }
+        /* Use a private zeroed page if zero_map_table is full. */
+        ppage_id = mmu_alloc(MMU_ZERO);
+    }
     page_info_table[ppage_id].pid      = pid;
     page_info_table[ppage_id].vpage_no = vpage_no;
 }
 
+static int page_is_zero(uint* addr) {
+    for (uint i = 0; i < PAGE_SIZE / sizeof(uint); i++)
+        if (addr[i]) return 0;
+    return 1;
+}
+
 void soft_tlb_switch(int pid) {
     static int curr_vm_pid = -1;
     if (pid == curr_vm_pid) return;
@@ -51,12 +143,31 @@ void soft_tlb_switch(int pid) {
             memcpy(PAGE_ID_TO_ADDR(i),
                    PAGE_NO_TO_ADDR(page_info_table[i].vpage_no), PAGE_SIZE);
 
+    /* A page mapped to the zero page gets a private page only after
+     * curr_vm_pid has written something to this page. */
+    for (uint i = 0; i < ZERO_MAP_CNT; i++) {
+        struct page_info* zero = &zero_map_table[i];
+        if (!zero->use || zero->pid != curr_vm_pid) continue;
+
+        char* vaddr = PAGE_NO_TO_ADDR(zero->vpage_no);
+        if (page_is_zero((uint*)vaddr)) continue;
+
+        uint ppage_id = mmu_alloc(MMU_NOZERO);
+        memcpy(PAGE_ID_TO_ADDR(ppage_id), vaddr, PAGE_SIZE);
+        soft_tlb_map(curr_vm_pid, zero->vpage_no, ppage_id);
+        memset(zero, 0, sizeof(struct page_info));
+    }
+
     /* Map pid to the user address space. */
     for (uint i = 0; i < APPS_PAGES_CNT; i++)
         if (page_info_table[i].use && page_info_table[i].pid == pid)
             memcpy(PAGE_NO_TO_ADDR(page_info_table[i].vpage_no),
                    PAGE_ID_TO_ADDR(i), PAGE_SIZE);
 
+    for (uint i = 0; i < ZERO_MAP_CNT; i++)
+        if (zero_map_table[i].use && zero_map_table[i].pid == pid)
+            memset(PAGE_NO_TO_ADDR(zero_map_table[i].vpage_no), 0, PAGE_SIZE);
+
     curr_vm_pid = pid;
 }
 
@@ -81,10 +192,9 @@ void setup_identity_region(int pid, uint addr, uint npages, uint flag) {
         leaf = (void*)((root[vpn1] << 2) & 0xFFFFF000);
     } else {
         /* Allocate the leaf page table. */
-        uint ppage_id                 = earth->mmu_alloc();
+        uint ppage_id                 = earth->mmu_alloc(MMU_ZERO);
         leaf                          = (void*)PAGE_ID_TO_ADDR(ppage_id);
         page_info_table[ppage_id].pid = pid;
-        memset(leaf, 0, PAGE_SIZE);
         root[vpn1] = ((uint)leaf >> 2) | 0x1;
     }
 
@@ -96,11 +206,10 @@ void setup_identity_region(int pid, uint addr, uint npages, uint flag) {
 
 void pagetable_identity_map(int pid) {
     /* Allocate the root page table. */
-    uint ppage_id                 = earth->mmu_alloc();
+    uint ppage_id                 = earth->mmu_alloc(MMU_ZERO);
     root                          = (void*)PAGE_ID_TO_ADDR(ppage_id);
     page_info_table[ppage_id].pid = pid;
     pid_to_pagetable_base[pid]    = root;
-    memset(root, 0, PAGE_SIZE);
 
     /* Setup the identity map for various memory regions. */
     for (uint i = RAM_START; i < RAM_END; i += PAGE_SIZE * 1024)
@@ -140,7 +249,10 @@ void page_table_map(int pid, uint vpage_no, uint ppage_id) {
      * | 0x80602000    | 1       | 4 KB   | Work dir (see apps/app.h)          |
      *
      * (2) After building page tables for pid (or if page tables for pid exist),
-     *     update the page tables and map vpage_no to ppage_id based on Sv32. */
+     *     update the page tables and map vpage_no to ppage_id based on Sv32.
+     * (3) If ppage_id is ZERO_PAGE_ID, map vpage_no as read-only to a zeroed
+     *     page shared by all processes, and allocate a private page for
+     *     vpage_no when the process writes this page (i.e., page fault). */
     soft_tlb_map(pid, vpage_no, ppage_id);
 
     /* Student's code ends here. */
@@ -187,6 +299,9 @@ void flush_cache() {
 void mmu_init() {
     earth->mmu_free        = mmu_free;
     earth->mmu_alloc       = mmu_alloc;
+    earth->mmu_unmap       = mmu_unmap;
+    earth->mmu_mapped      = mmu_mapped;
+    earth->mmu_prezero     = mmu_prezero;
     earth->mmu_flush_cache = flush_cache;
 
     /* Setup a PMP region for the whole 4GB address space. */
@@ -20,6 +20,7 @@
 #define SIFIVE_SPI_CSMODE 24UL
 #define SIFIVE_SPI_TXDATA 72UL
 #define SIFIVE_SPI_RXDATA 76UL
+#define SIFIVE_SPI_FIFO   8 /* depth of the TX and RX FIFOs */
 
 char spi_exchange(char byte) {
     /* The "exchange" here means sending a byte and then receiving a byte. */
@@ -37,6 +38,31 @@ char spi_exchange(char byte) {
     return (char)(rxdata & 0xFF);
 }
 
+static void spi_transfer(char* tx, char* rx, uint len) {
+    /* Exchange len bytes; Send 0xFF if tx is NULL and drop the received
+     * bytes if rx is NULL. */
+    if (earth->platform == ARTY) {
+        for (uint i = 0; i < len; i++) {
+            char byte = spi_exchange(tx ? tx[i] : 0xFF);
+            if (rx) rx[i] = byte;
+        }
+        return;
+    }
+
+    /* Keep up to SIFIVE_SPI_FIFO bytes in flight, so the TX FIFO is filled
+     * while the RX FIFO is drained and the RX FIFO never overflows. */
+    for (uint rxdata, sent = 0, recv = 0; recv < len;) {
+        if (sent < len && sent - recv < SIFIVE_SPI_FIFO) {
+            REGW(SPI_BASE, SIFIVE_SPI_TXDATA) = tx ? tx[sent] : 0xFF;
+            sent++;
+        }
+        if (!((rxdata = REGW(SPI_BASE, SIFIVE_SPI_RXDATA)) & (1 << 31))) {
+            if (rx) rx[recv] = (char)(rxdata & 0xFF);
+            recv++;
+        }
+    }
+}
+
 void spi_set_clock(uint freq) {
 #define CPU_CLOCK_RATE 100000000 /* 100MHz */
     uint div                         = CPU_CLOCK_RATE / freq + 1;
@@ -45,7 +71,7 @@ void spi_set_clock(uint freq) {
 
 static char sd_exec_cmd(char* cmd) {
     /* Send a 6-byte SD card command through the SPI bus. */
-    for (uint i = 0; i < 6; i++) spi_exchange(cmd[i]);
+    spi_transfer(cmd, NULL, 6);
 
     for (uint reply, i = 0; i < 8000; i++)
         if ((reply = spi_exchange(0xFF)) != 0xFF) return reply;
@@ -62,55 +88,144 @@ static char sd_exec_acmd(char* cmd) {
     return sd_exec_cmd(cmd);
 }
 
-static void sd_read(uint offset, char* dst) {
-    /* QEMU uses the SD2 standard (offset is *byte* offset).
-     * Arty uses the SDHC/SDXC standard (offset is *block* offset). */
-    if (earth->platform == QEMU) offset *= BLOCK_SIZE;
-
+static void sd_wait_ready() {
     /* Wait until SD card is not busy. */
     while (spi_exchange(0xFF) != 0xFF);
+}
 
-    /* Send read request with cmd17. */
-    char* arg = (void*)&offset;
-    char reply, cmd17[] = {0x51, arg[3], arg[2], arg[1], arg[0], 0xFF};
-
-    if (reply = sd_exec_cmd(cmd17))
-        FATAL("SD card replies cmd17 with status 0x%.2x", reply);
-
-    /* Wait for the data packet and ignore the 2-byte checksum. */
-    while (spi_exchange(0xFF) != 0xFE);
-    for (uint i = 0; i < BLOCK_SIZE; i++) dst[i] = spi_exchange(0xFF);
-    spi_exchange(0xFF);
+static void sd_stop_read() {
+    /* Send cmd12 to stop a multi-block read; The card replies after a
+     * stuff byte, and the data bytes received before the reply are ignored. */
+    char reply, cmd12[] = {0x4C, 0x00, 0x00, 0x00, 0x00, 0xFF};
+    spi_transfer(cmd12, NULL, 6);
     spi_exchange(0xFF);
+
+    for (uint i = 0; i < 10 && ((reply = spi_exchange(0xFF)) & 0x80); i++);
+    if (reply) FATAL("SD card replies cmd12 with status 0x%.2x", reply);
+    sd_wait_ready();
 }
 
-static void sd_write(uint offset, char* src) {
+static void sd_send_cmd(uint type, uint offset, uint nblocks) {
     /* QEMU uses the SD2 standard (offset is *byte* offset).
      * Arty uses the SDHC/SDXC standard (offset is *block* offset). */
     if (earth->platform == QEMU) offset *= BLOCK_SIZE;
 
-    /* Wait until SD card is not busy. */
-    while (spi_exchange(0xFF) != 0xFF);
-
-    /* Send write request with cmd24. */
+    /* Read with cmd17 (one block) or cmd18 (multiple blocks).
+     * Write with cmd24 (one block) or cmd25 (multiple blocks). */
     char* arg = (void*)&offset;
-    char reply, cmd24[] = {0x58, arg[3], arg[2], arg[1], arg[0], 0xFF};
-    if (reply = sd_exec_cmd(cmd24))
-        FATAL("SD card replies cmd24 with status %.2x", reply);
+    char id   = (type == DISK_READ) ? 17 : 24;
+    char reply, cmd[] = {0x40 | (id + (nblocks > 1)), arg[3], arg[2], arg[1],
+                         arg[0], 0xFF};
+    if (reply = sd_exec_cmd(cmd))
+        FATAL("SD card replies cmd%d with status 0x%.2x", cmd[0] & 0x3F, reply);
 
     /* Transfer 1-byte buffer before writing block. */
-    spi_exchange(0xFF);
+    if (type == DISK_WRITE) spi_exchange(0xFF);
+}
 
-    /* Send data packet: token + block + dummy 2-byte checksum. */
-    spi_exchange(0xFE);
-    for (uint i = 0; i < BLOCK_SIZE; i++) spi_exchange(src[i]);
-    spi_exchange(0xFF);
-    spi_exchange(0xFF);
+/* The disk requests are served from queue_head by sd_step() below. Every step
+ * returns 0 instead of waiting if the SD card is not ready, so the kernel can
+ * poll the disk and run other processes while the SD card is busy. */
+static struct disk_request* queue_head;
+static enum {
+    SD_IDLE,        /* send a command for the requests from queue_head */
+    SD_READ_TOKEN,  /* wait for the next data packet of a read         */
+    SD_WRITE_BLOCK, /* send the next data packet of a write            */
+    SD_WRITE_BUSY   /* wait for the SD card to program a data packet   */
+} sd_state;
+
+/* A command serves queue_head and the requests for the blocks right after it,
+ * up to cmd_last; sd_nblocks_done counts the blocks done for queue_head. */
+static struct disk_request* cmd_last;
+static uint cmd_nblocks, cmd_nblocks_left, sd_nblocks_done;
+static uint disk_pos; /* the block after the last request served */
+
+static int sd_step() {
+    struct disk_request* req = queue_head;
+    char reply, *buf = req->buf + sd_nblocks_done * BLOCK_SIZE;
+
+    switch (sd_state) {
+    case SD_IDLE:
+        if (spi_exchange(0xFF) != 0xFF) return 0;
+
+        /* Merge the requests for adjacent blocks into one command. */
+        cmd_last    = req;
+        cmd_nblocks = req->nblocks;
+        for (struct disk_request* next; next = cmd_last->next; cmd_last = next)
+            if (next->type == req->type &&
+                next->block_no == req->block_no + cmd_nblocks)
+                cmd_nblocks += next->nblocks;
+            else
+                break;
+
+        cmd_nblocks_left = cmd_nblocks;
+        sd_send_cmd(req->type, req->block_no, cmd_nblocks);
+        sd_state = (req->type == DISK_READ) ? SD_READ_TOKEN : SD_WRITE_BLOCK;
+        return 1;
+    case SD_READ_TOKEN:
+        /* Receive the data packet and ignore the 2-byte checksum. */
+        if (spi_exchange(0xFF) != 0xFE) return 0;
+        spi_transfer(NULL, buf, BLOCK_SIZE);
+        spi_transfer(NULL, NULL, 2);
+        break;
+    case SD_WRITE_BLOCK:
+        /* Send data packet: token + block + dummy 2-byte checksum. */
+        spi_exchange(cmd_nblocks == 1 ? 0xFE : 0xFC);
+        spi_transfer(buf, NULL, BLOCK_SIZE);
+        spi_transfer(NULL, NULL, 2);
+
+        /* Wait for SD card ack of data packet. */
+        while ((reply = spi_exchange(0xFF)) == 0xFF);
+        if ((reply & 0x1F) != 0x05)
+            FATAL("SD card write ack with status 0x%.2x", reply);
+        sd_state = SD_WRITE_BUSY;
+        return 1;
+    case SD_WRITE_BUSY:
+        if (spi_exchange(0xFF) != 0xFF) return 0;
+        sd_state = SD_WRITE_BLOCK;
+        break;
+    }
 
-    /* Wait for SD card ack of data packet. */
-    while ((reply = spi_exchange(0xFF)) == 0xFF);
-    if ((reply & 0x1F) != 0x05)
-        FATAL("SD card write ack with status 0x%.2x", reply);
+    /* A block is done; Stop cmd18 with cmd12 and cmd25 with the stop token,
+     * after which SD_IDLE waits until the SD card is not busy. */
+    if (--cmd_nblocks_left == 0) {
+        if (cmd_nblocks > 1 && req->type == DISK_READ) sd_stop_read();
+        if (cmd_nblocks > 1 && req->type == DISK_WRITE) {
+            spi_exchange(0xFD);
+            spi_exchange(0xFF);
+        }
+        sd_state = SD_IDLE;
+    }
+
+    if (++sd_nblocks_done == req->nblocks) {
+        sd_nblocks_done = 0;
+        disk_pos        = req->block_no + req->nblocks;
+        queue_head      = req->next;
+        req->status     = DISK_DONE;
+    }
+    return 1;
+}
+
+#define DISK_MAX_BYPASS 8 /* a request is passed by at most 8 later requests */
+
+static void disk_enqueue(struct disk_request* req) {
+    /* Do not pass the requests of the current command or the requests which
+     * have been passed DISK_MAX_BYPASS times, so no request starves. */
+    struct disk_request** prev = &queue_head;
+    uint in_cmd                = (sd_state != SD_IDLE);
+    for (struct disk_request** p = &queue_head; *p; p = &(*p)->next) {
+        if (in_cmd || (*p)->nbypass >= DISK_MAX_BYPASS) prev = &(*p)->next;
+        if (*p == cmd_last) in_cmd = 0;
+    }
+
+    /* Elevator (C-SCAN): sort the requests by block number, starting from
+     * disk_pos and wrapping around to block 0. */
+    uint dist = req->block_no - disk_pos;
+    while (*prev && (*prev)->block_no - disk_pos <= dist) prev = &(*prev)->next;
+
+    req->next = *prev;
+    *prev     = req;
+    for (struct disk_request* r = req->next; r; r = r->next) r->nbypass++;
 }
 
 static int sd_init() {
@@ -163,6 +278,20 @@ static int sd_init() {
 
 static enum disk_type { SD_CARD, FLASH_ROM } type;
 
+/* disk_lock is held when a process or the kernel is talking to the SD card. */
+static int disk_lock;
+
+static void disk_sync(struct disk_request* req) {
+    /* Serve the queued requests first and then req; The process holds
+     * disk_lock until req is done, so the kernel does not poll the disk
+     * in the middle (see disk_poll). */
+    acquire(disk_lock);
+    while (queue_head) sd_step();
+    queue_head = req;
+    while (req->status != DISK_DONE) sd_step();
+    release(disk_lock);
+}
+
 void disk_read(uint block_no, uint nblocks, char* dst) {
     if (type == FLASH_ROM) {
         char* src = (char*)BOARD_FLASH_ROM + block_no * BLOCK_SIZE;
@@ -170,32 +299,51 @@ void disk_read(uint block_no, uint nblocks, char* dst) {
         return;
     }
 
-    /* Student's code goes here (Serial Device Driver). */
-
-    /* Replace the loop below by reading multiple SD card
-     * blocks altogether using the cmd18 SD card command. */
-    for (uint i = 0; i < nblocks; i++)
-        sd_read(block_no + i, dst + BLOCK_SIZE * i);
-
-    /* Student's code ends here. */
+    struct disk_request req = {DISK_READ, DISK_QUEUED, block_no, nblocks, dst};
+    if (nblocks) disk_sync(&req);
 }
 
 void disk_write(uint block_no, uint nblocks, char* src) {
     if (type == FLASH_ROM) FATAL("disk_write: Writing to ROM");
 
-    /* Student's code goes here (Serial Device Driver). */
+    struct disk_request req = {DISK_WRITE, DISK_QUEUED, block_no, nblocks, src};
+    if (nblocks) disk_sync(&req);
+}
 
-    /* Replace the loop below by writing multiple SD card
-     * blocks altogether using the cmd25 SD card command. */
-    for (uint i = 0; i < nblocks; i++)
-        sd_write(block_no + i, src + BLOCK_SIZE * i);
+void disk_submit(struct disk_request* req) {
+    if (type == FLASH_ROM && req->type == DISK_WRITE)
+        FATAL("disk_submit: Writing to ROM");
+    if (type == FLASH_ROM || req->nblocks == 0) {
+        /* Serve req right away (see disk_read). */
+        disk_read(req->block_no, req->nblocks, req->buf);
+        req->status = DISK_DONE;
+        return;
+    }
+
+    /* If a process holds disk_lock, req stays DISK_NEW and the kernel submits
+     * it again later (see proc_try_disk and proc_disk_slots). */
+    if (__sync_lock_test_and_set(&disk_lock, 1) != 0) return;
+    req->nbypass = 0;
+    req->status  = DISK_QUEUED;
+    disk_enqueue(req);
+    release(disk_lock);
+}
 
-    /* Student's code ends here. */
+uint disk_poll() {
+    /* The kernel calls disk_poll() when scheduling the next process; Return
+     * whether some requests are still in the queue. */
+    if (__sync_lock_test_and_set(&disk_lock, 1) != 0) return 1;
+    while (queue_head && sd_step());
+    uint busy = (queue_head != NULL);
+    release(disk_lock);
+    return busy;
 }
 
 void disk_init() {
-    earth->disk_read  = disk_read;
-    earth->disk_write = disk_write;
+    earth->disk_read   = disk_read;
+    earth->disk_write  = disk_write;
+    earth->disk_submit = disk_submit;
+    earth->disk_poll   = disk_poll;
 
     type = (sd_init() == 0) ? SD_CARD : FLASH_ROM;
     if (type == FLASH_ROM) CRITICAL("Using FLASH_ROM instead of SD_CARD");
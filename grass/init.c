@@ -9,19 +9,21 @@
 #include "process.h"
 #include "elf.h"
 
-static void sys_proc_read(uint block_no, char* dst) {
-    earth->disk_read(SYS_PROC_EXEC_START + block_no, 1, dst);
+static void sys_proc_read(uint block_no, uint nblocks, char* dst) {
+    earth->disk_read(SYS_PROC_EXEC_START + block_no, nblocks, dst);
 }
 
 void grass_entry() {
     SUCCESS("Enter the grass layer");
 
     /* Initialize the grass interface. */
-    grass->proc_free      = proc_free;
-    grass->proc_alloc     = proc_alloc;
-    grass->proc_set_ready = proc_set_ready;
-    grass->sys_send       = sys_send;
-    grass->sys_recv       = sys_recv;
+    grass->proc_free       = proc_free;
+    grass->proc_alloc      = proc_alloc;
+    grass->proc_set_ready  = proc_set_ready;
+    grass->sys_send        = sys_send;
+    grass->sys_recv        = sys_recv;
+    grass->sys_disk        = sys_disk;
+    grass->sys_disk_submit = sys_disk_submit;
     /* Student's code goes here (System Call | Multicore & Locks). */
 
     /* Initialize the grass interface for proc_sleep() or proc_coresinfo(). */
@@ -47,16 +47,39 @@ void kernel_entry() {
 #define INTR_ID_TIMER   7
 #define EXCP_ID_ECALL_U 8
 #define EXCP_ID_ECALL_M 11
+#define PREZERO_NPAGES  2 /* pages zeroed in the background per timer tick */
 static void proc_yield();
 static void proc_try_syscall(struct process* proc);
+static uint proc_disk_slots();
+
+static void syscall_copy_out(struct process* proc) {
+    /* Copy the system call struct of proc back to user space, with only the
+     * size bytes of the message in content[]. */
+    uint syscall_paddr = earth->mmu_translate(proc->pid, SYSCALL_ARG);
+    memcpy((void*)syscall_paddr, &proc->syscall,
+           SYSCALL_HEADER_LEN + proc->syscall.size);
+}
 
 static void excp_entry(uint id) {
     if (id >= EXCP_ID_ECALL_U && id <= EXCP_ID_ECALL_M) {
-        /* Copy the system call arguments from user space to the kernel. */
-        uint syscall_paddr = earth->mmu_translate(curr_pid, SYSCALL_ARG);
-        memcpy(&proc_set[curr_proc_idx].syscall, (void*)syscall_paddr,
-               sizeof(struct syscall));
-        proc_set[curr_proc_idx].syscall.status = PENDING;
+        /* Copy the system call arguments from user space to the kernel, with
+         * only the size bytes of the message to send. */
+        struct syscall* sc = &proc_set[curr_proc_idx].syscall;
+        struct syscall* user_sc =
+            (void*)earth->mmu_translate(curr_pid, SYSCALL_ARG);
+        memcpy(sc, user_sc, SYSCALL_HEADER_LEN);
+        if (sc->type == SYS_RECV) sc->size = 0;
+        if (sc->type == SYS_DISK || sc->type == SYS_DISK_SUBMIT)
+            sc->size = sizeof(struct disk_request);
+        if (sc->size > SYSCALL_MSG_LEN) sc->size = SYSCALL_MSG_LEN;
+        memcpy(sc->content, user_sc->content, sc->size);
+
+        sc->status = PENDING;
+        if (sc->type == SYS_DISK) {
+            /* Do not trust the status of the disk request from user space. */
+            struct disk_request* req = (void*)sc->content;
+            req->status              = DISK_NEW;
+        }
 
         proc_set_pending(curr_pid);
         proc_set[curr_proc_idx].mepc += 4;
@@ -79,6 +102,11 @@ static void intr_entry(uint id) {
     /* Update the process lifecycle statistics. */
 
     /* Student's code ends here. */
+
+    /* Zeroing a page with memset() in string.s takes about 1200 instructions,
+     * and it stops once the pool is full; A quantum is 10ms on QEMU and 0.5s
+     * on the Arty board (see earth/cpu_intr.c). */
+    earth->mmu_prezero(PREZERO_NPAGES);
     proc_yield();
 }
 
@@ -93,14 +121,19 @@ static void proc_yield() {
      * [System Call & Protection]
      * Do not schedule a process that should still be sleeping at this time. */
 
+    /* Poll the disk before looking for the next process to run; If only a
+     * process waiting for the disk has work to do, keep polling the disk. */
     int next_idx = MAX_NPROCESS;
-    for (uint i = 1; i <= MAX_NPROCESS; i++) {
-        struct process* p = &proc_set[(curr_proc_idx + i) % MAX_NPROCESS];
-        if (p->status == PROC_PENDING_SYSCALL) proc_try_syscall(p);
-
-        if (p->status == PROC_READY || p->status == PROC_RUNNABLE) {
-            next_idx = (curr_proc_idx + i) % MAX_NPROCESS;
-            break;
+    for (uint disk_busy = 1; next_idx == MAX_NPROCESS && disk_busy;) {
+        disk_busy = earth->disk_poll() | proc_disk_slots();
+        for (uint i = 1; i <= MAX_NPROCESS; i++) {
+            struct process* p = &proc_set[(curr_proc_idx + i) % MAX_NPROCESS];
+            if (p->status == PROC_PENDING_SYSCALL) proc_try_syscall(p);
+
+            if (p->status == PROC_READY || p->status == PROC_RUNNABLE) {
+                next_idx = (curr_proc_idx + i) % MAX_NPROCESS;
+                break;
+            }
         }
     }
 
@@ -150,25 +183,101 @@ static void proc_try_send(struct process* sender) {
 
             dst->syscall.status = DONE;
             dst->syscall.sender = sender->pid;
-            /* Copy the system call arguments within the kernel PCB. */
+            /* Copy the message within the kernel PCB. */
+            dst->syscall.size = sender->syscall.size;
             memcpy(dst->syscall.content, sender->syscall.content,
-                   SYSCALL_MSG_LEN);
+                   sender->syscall.size);
             return;
         }
     }
     FATAL("proc_try_send: unknown receiver pid=%d", sender->syscall.receiver);
 }
 
+/* A request of SYS_DISK_SUBMIT stays in a slot until the disk serves it and
+ * the process which submitted it receives it from GPID_UNUSED. */
+#define DISK_NSLOTS 4
+static struct disk_slot {
+    int pid; /* 0 means unused */
+    struct disk_request req;
+} disk_slots[DISK_NSLOTS];
+
+/* GPID_FILE receives a tick from GPID_UNUSED, a zeroed disk request, about
+ * once per second while it waits for any message, so that it writes back
+ * its dirty blocks even if no request comes in. */
+#define FILE_TICK_PERIOD (earth->platform == QEMU ? 10000000 : 100000000)
+static ulonglong file_last_tick;
+
 static void proc_try_recv(struct process* receiver) {
+    /* A served SYS_DISK_SUBMIT request is received from GPID_UNUSED. */
+    int from = receiver->syscall.sender;
+    for (uint i = 0; i < DISK_NSLOTS; i++) {
+        struct disk_slot* slot = &disk_slots[i];
+        if (receiver->syscall.status == PENDING &&
+            (from == GPID_ALL || from == GPID_UNUSED) &&
+            slot->pid == receiver->pid && slot->req.status == DISK_DONE) {
+            receiver->syscall.status = DONE;
+            receiver->syscall.sender = GPID_UNUSED;
+            receiver->syscall.size   = sizeof(slot->req);
+            memcpy(receiver->syscall.content, &slot->req, sizeof(slot->req));
+            slot->pid = 0;
+        }
+    }
+    if (receiver->pid == GPID_FILE && receiver->syscall.status == PENDING &&
+        from == GPID_ALL && mtime_get() - file_last_tick >= FILE_TICK_PERIOD) {
+        receiver->syscall.status = DONE;
+        receiver->syscall.sender = GPID_UNUSED;
+        receiver->syscall.size   = sizeof(struct disk_request);
+        memset(receiver->syscall.content, 0, sizeof(struct disk_request));
+        file_last_tick = mtime_get();
+    }
     if (receiver->syscall.status == PENDING) return;
-
-    /* Copy the system call struct from the kernel back to user space. */
-    uint syscall_paddr = earth->mmu_translate(receiver->pid, SYSCALL_ARG);
-    memcpy((void*)syscall_paddr, &receiver->syscall, sizeof(struct syscall));
+    syscall_copy_out(receiver);
 
     /* Set the receiver and sender back to RUNNABLE. */
     proc_set_runnable(receiver->pid);
-    proc_set_runnable(receiver->syscall.sender);
+    if (receiver->syscall.sender != GPID_UNUSED)
+        proc_set_runnable(receiver->syscall.sender);
+}
+
+static void proc_try_disk(struct process* proc) {
+    /* The disk request stays in the kernel PCB until the disk serves it;
+     * excp_entry() sets it to DISK_NEW when the system call is entered. */
+    struct disk_request* req = (void*)proc->syscall.content;
+    if (req->status == DISK_NEW) earth->disk_submit(req);
+    if (req->status != DISK_DONE) return;
+
+    proc->syscall.status = DONE;
+    syscall_copy_out(proc);
+    proc_set_runnable(proc->pid);
+}
+
+static void proc_try_disk_submit(struct process* proc) {
+    /* Wait for a free slot, and let the process run once it has one. */
+    for (uint i = 0; i < DISK_NSLOTS; i++) {
+        struct disk_slot* slot = &disk_slots[i];
+        if (slot->pid != 0) continue;
+
+        slot->pid = proc->pid;
+        memcpy(&slot->req, proc->syscall.content, sizeof(slot->req));
+        slot->req.status = DISK_NEW;
+        earth->disk_submit(&slot->req);
+        proc->syscall.status = DONE;
+        proc_set_runnable(proc->pid);
+        return;
+    }
+}
+
+static uint proc_disk_slots() {
+    /* disk_submit() leaves a request DISK_NEW if a process holds disk_lock,
+     * so submit such slots again; Return whether a slot is not served. */
+    uint busy = 0;
+    for (uint i = 0; i < DISK_NSLOTS; i++) {
+        struct disk_slot* slot = &disk_slots[i];
+        if (slot->pid == 0) continue;
+        if (slot->req.status == DISK_NEW) earth->disk_submit(&slot->req);
+        if (slot->req.status != DISK_DONE) busy = 1;
+    }
+    return busy;
 }
 
 static void proc_try_syscall(struct process* proc) {
@@ -179,6 +288,12 @@ static void proc_try_syscall(struct process* proc) {
     case SYS_SEND:
         proc_try_send(proc);
         break;
+    case SYS_DISK:
+        proc_try_disk(proc);
+        break;
+    case SYS_DISK_SUBMIT:
+        proc_try_disk_submit(proc);
+        break;
     default:
         FATAL("proc_try_syscall: unknown syscall type=%d", proc->syscall.type);
     }
@@ -5,13 +5,27 @@ typedef unsigned short ushort;
 typedef unsigned int uint;
 typedef unsigned long long ulonglong;
 
+enum mmu_alloc_flag {
+    MMU_NOZERO, /* the caller will overwrite the whole page */
+    MMU_ZERO    /* the caller needs a zero-filled page      */
+};
+
+/* mmu_map() maps a page to the zero page shared by all processes if ppage_id
+ * is ZERO_PAGE_ID; The process gets a private page after writing the page. */
+#define ZERO_PAGE_ID 0xFFFFFFFF
+
+struct disk_request; /* see library/file/disk.h */
+
 struct earth {
-    uint (*mmu_alloc)();
+    uint (*mmu_alloc)(uint flag);
     void (*mmu_free)(int pid);
+    void (*mmu_prezero)(uint npages);
     void (*mmu_flush_cache)();
     void (*timer_reset)(uint core_id);
 
     void (*mmu_map)(int pid, uint vpage_no, uint ppage_id);
+    void (*mmu_unmap)(int pid, uint vpage_no);
+    uint (*mmu_mapped)(int pid, uint vpage_no);
     uint (*mmu_translate)(int pid, uint vaddr);
     void (*mmu_switch)(int pid);
 
@@ -20,6 +34,8 @@ struct earth {
     uint (*tty_input_empty)();
     void (*disk_read)(uint block_no, uint nblocks, char* dst);
     void (*disk_write)(uint block_no, uint nblocks, char* src);
+    void (*disk_submit)(struct disk_request* req);
+    uint (*disk_poll)();
 
     enum { ARTY, QEMU } platform;
     enum { PAGE_TABLE, SOFT_TLB } translation;
@@ -32,6 +48,8 @@ struct grass {
 
     void (*sys_send)(int receiver, char* msg, uint size);
     void (*sys_recv)(int from, int* sender, char* buf, uint size);
+    void (*sys_disk)(struct disk_request* req);
+    void (*sys_disk_submit)(struct disk_request* req);
     /* Student's code goes here (System Call | Multicore & Locks). */
 
     /* Add interface functions for process sleep and multicore information. */
@@ -45,7 +63,9 @@ extern struct grass* grass;
 /* Below is the physical memory layout in egos-2000. */
 #define RAM_END           0x81000000 /* 16MB memory [0x80000000,0x81000000) */
 #define APPS_PAGES_BASE   0x80800000 /* 8MB free for mmu_alloc              */
-#define APPS_STACK_TOP    0x80800000 /* 2MB app stack (growing down)        */
+#define APPS_STACK_TOP    0x80800000 /* 1MB app stack (growing down)        */
+#define APPS_MMAP_END     0x80700000 /* memory-mapped files (growing up)    */
+#define APPS_MMAP_BASE    0x80603000 /* [APPS_MMAP_BASE, APPS_MMAP_END)     */
 #define SHELL_WORK_DIR    0x80602000 /* current work directory for shell    */
 #define SYSCALL_ARG       0x80601000 /* struct syscall                      */
 #define APPS_ARG          0x80600000 /* main() arguments (argc and argv)    */
@@ -75,6 +95,12 @@ extern struct grass* grass;
 #define acquire(x) while (__sync_lock_test_and_set(&x, 1) != 0);
 extern int boot_lock, kernel_lock, booted_core_cnt;
 
+struct heap_stats {
+    uint nmalloc, nfree; /* number of malloc() and free() calls   */
+    uint in_use, size;   /* bytes allocated and bytes in the heap  */
+};
+void heap_get_stats(struct heap_stats* stats); /* see libc/malloc.c */
+
 #define printf my_printf
 int INFO(const char* format, ...);
 int FATAL(const char* format, ...);
@@ -16,8 +16,8 @@
 
 void elf_load(int pid, elf_reader reader, int argc, void** argv) {
     /* Load the ELF header. */
-    char hbuf[BLOCK_SIZE], buf[BLOCK_SIZE];
-    reader(0, hbuf);
+    char hbuf[BLOCK_SIZE];
+    reader(0, 1, hbuf);
     struct elf32_header* header          = (void*)hbuf;
     struct elf32_program_header* pheader = (void*)(hbuf + header->e_phoff);
 
@@ -29,33 +29,34 @@ void elf_load(int pid, elf_reader reader, int argc, void** argv) {
         uint memsz        = pheader[i].p_memsz;
         uint filesz       = pheader[i].p_filesz;
         uint curr_pageno  = addr / PAGE_SIZE;
-        uint end_pageno   = (addr + memsz) / PAGE_SIZE;
+        uint end_pageno   = (addr + memsz + PAGE_SIZE - 1) / PAGE_SIZE;
         uint curr_blockno = pheader[i].p_offset / BLOCK_SIZE;
-        for (uint ppage_id, off = 0; off < filesz; off += BLOCK_SIZE) {
-            /* Allocate one page (4KB) for every 8 blocks (512 bytes). */
-            if (off % PAGE_SIZE == 0) {
-                ppage_id = earth->mmu_alloc();
-                earth->mmu_map(pid, curr_pageno++, ppage_id);
-                memset(PAGE_ID_TO_ADDR(ppage_id), 0, PAGE_SIZE);
-            }
-            uint size =
-                (off + BLOCK_SIZE < filesz) ? BLOCK_SIZE : (filesz - off);
-            reader(curr_blockno++, buf);
-            memcpy(PAGE_ID_TO_ADDR(ppage_id) + (off % PAGE_SIZE), buf, size);
-        }
-
-        while (curr_pageno < end_pageno) {
-            uint ppage_id = earth->mmu_alloc();
+        for (uint off = 0; off < filesz; off += PAGE_SIZE) {
+            /* Read the blocks of a page (4KB) with one reader call straight
+             * into the page; Only the tail not covered by the file, which
+             * may hold bytes of the last block beyond filesz, is zeroed. */
+            uint ppage_id = earth->mmu_alloc(MMU_NOZERO);
             earth->mmu_map(pid, curr_pageno++, ppage_id);
-            memset(PAGE_ID_TO_ADDR(ppage_id), 0, PAGE_SIZE);
+
+            char* page = PAGE_ID_TO_ADDR(ppage_id);
+            uint size  = (filesz - off < PAGE_SIZE) ? filesz - off : PAGE_SIZE;
+
+            uint nblocks = (size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+            reader(curr_blockno, nblocks, page);
+            curr_blockno += nblocks;
+            memset(page + size, 0, PAGE_SIZE - size);
         }
 
+        /* The bss pages not covered by the file share the zero page. */
+        while (curr_pageno < end_pageno)
+            earth->mmu_map(pid, curr_pageno++, ZERO_PAGE_ID);
+
         /* Numbers printed should match the numbers in build/debug/sys_*.lst. */
         if (pid <= GPID_SHELL) INFO("Load 0x%x bytes to 0x%x", filesz, addr);
     }
 
     /* Setup a page for main() arguments (argc and argv). */
-    uint ppage_id = earth->mmu_alloc();
+    uint ppage_id = earth->mmu_alloc(MMU_NOZERO);
     earth->mmu_map(pid, APPS_ARG / PAGE_SIZE, ppage_id);
 
     int* argc_addr = (int*)PAGE_ID_TO_ADDR(ppage_id);
@@ -70,12 +71,12 @@ void elf_load(int pid, elf_reader reader, int argc, void** argv) {
                        sizeof(void*) * CMD_NARGS /* argv */ + i * CMD_ARG_LEN;
 
     /* Setup a page for system call arguments. */
-    ppage_id = earth->mmu_alloc();
+    ppage_id = earth->mmu_alloc(MMU_NOZERO);
     earth->mmu_map(pid, SYSCALL_ARG / PAGE_SIZE, ppage_id);
 
     /* Setup 2 pages for user stack (enough for teaching purpose). */
     for (uint i = 1; i <= 2; i++) {
-        ppage_id = earth->mmu_alloc();
+        ppage_id = earth->mmu_alloc(MMU_NOZERO);
         earth->mmu_map(pid, APPS_STACK_TOP / PAGE_SIZE - i, ppage_id);
     }
 }
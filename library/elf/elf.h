@@ -28,5 +28,6 @@ struct elf32_program_header {
     uint p_align;
 };
 
-typedef void (*elf_reader)(uint block_no, char* dst);
+/* An elf_reader reads nblocks blocks of the file into dst. */
+typedef void (*elf_reader)(uint block_no, uint nblocks, char* dst);
 void elf_load(int pid, elf_reader reader, int argc, void** argv);
@@ -0,0 +1,280 @@
+/*
+ * (C) 2025, Cornell University
+ * All rights reserved.
+ *
+ * Description: a block cache as an inode store layer
+ * cachedisk_init(below, nblocks) keeps up to nblocks blocks of the inode store
+ * below in memory. A hash table finds the cached blocks and the least recently
+ * used block is evicted when the cache is full.
+ *
+ * With write_through, a write updates both the cache and the inode store
+ * below. Otherwise (write-back), a write only marks the cached block dirty;
+ * The dirty blocks are written below, sorted by inode and offset, when a
+ * dirty block is evicted or when cachedisk_sync() is called.
+ */
+
+#include "egos.h"
+#include "inode.h"
+#include <stdlib.h>
+#include <string.h>
+
+struct cache_entry {
+    uint ino, offset, dirty;
+    struct cache_entry* hash_next;           /* bucket list or free list */
+    struct cache_entry *lru_prev, *lru_next; /* circular LRU list        */
+    block_t block;
+};
+
+#define FLUSH_NBLOCKS 8
+
+struct cache_state {
+    inode_intf below;
+    uint nbuckets, write_through;
+    struct cache_entry** buckets;
+    struct cache_entry** dirty; /* buffer for sorting the dirty blocks */
+    block_t* flush_buf;         /* buffer for writing the dirty blocks */
+    struct cache_entry* free_list;
+    struct cache_entry lru; /* lru.lru_next is the most recently used */
+    struct cache_stats stats;
+};
+
+static struct cache_entry** bucket(struct cache_state* cs, uint ino,
+                                   uint offset) {
+    return &cs->buckets[(ino * 31 + offset) % cs->nbuckets];
+}
+
+static void lru_remove(struct cache_entry* e) {
+    e->lru_prev->lru_next = e->lru_next;
+    e->lru_next->lru_prev = e->lru_prev;
+}
+
+static void lru_push(struct cache_state* cs, struct cache_entry* e) {
+    e->lru_prev                = &cs->lru;
+    e->lru_next                = cs->lru.lru_next;
+    cs->lru.lru_next->lru_prev = e;
+    cs->lru.lru_next           = e;
+}
+
+static struct cache_entry* cache_find(struct cache_state* cs, uint ino,
+                                      uint offset) {
+    struct cache_entry* e = *bucket(cs, ino, offset);
+    while (e && (e->ino != ino || e->offset != offset)) e = e->hash_next;
+    return e;
+}
+
+static struct cache_entry* cache_lookup(struct cache_state* cs, uint ino,
+                                        uint offset) {
+    struct cache_entry* e = cache_find(cs, ino, offset);
+    if (e) {
+        lru_remove(e);
+        lru_push(cs, e);
+    }
+    return e;
+}
+
+static void cache_remove(struct cache_state* cs, struct cache_entry* e) {
+    struct cache_entry** prev = bucket(cs, e->ino, e->offset);
+    while (*prev != e) prev = &(*prev)->hash_next;
+    *prev = e->hash_next;
+    lru_remove(e);
+
+    e->hash_next  = cs->free_list;
+    cs->free_list = e;
+}
+
+static int entry_cmp(const void* a, const void* b) {
+    struct cache_entry* x = *(struct cache_entry**)a;
+    struct cache_entry* y = *(struct cache_entry**)b;
+    if (x->ino != y->ino) return x->ino < y->ino ? -1 : 1;
+    return x->offset < y->offset ? -1 : (x->offset > y->offset);
+}
+
+static int cache_write_run(struct cache_state* cs, struct cache_entry** run,
+                           uint n) {
+    /* Write n dirty blocks at adjacent offsets of an inode with one writev,
+     * and mark them clean only once the writev succeeds. */
+    for (uint i = 0; i < n; i++)
+        memcpy(&cs->flush_buf[i], &run[i]->block, BLOCK_SIZE);
+    if (cs->below->writev(cs->below, run[0]->ino, run[0]->offset, n,
+                          cs->flush_buf) < 0)
+        return -1;
+
+    for (uint i = 0; i < n; i++) run[i]->dirty = 0;
+    cs->stats.nwritebacks += n;
+    return 0;
+}
+
+static int cache_flush(struct cache_state* cs) {
+    uint ndirty = 0;
+    struct cache_entry* e;
+    for (e = cs->lru.lru_next; e != &cs->lru; e = e->lru_next)
+        if (e->dirty) cs->dirty[ndirty++] = e;
+
+    /* Write the dirty blocks of an inode in the order of offset, and write
+     * up to FLUSH_NBLOCKS adjacent blocks with one writev. */
+    qsort(cs->dirty, ndirty, sizeof(struct cache_entry*), entry_cmp);
+    for (uint i = 0, n; i < ndirty; i += n) {
+        e = cs->dirty[i];
+        for (n = 1; n < FLUSH_NBLOCKS && i + n < ndirty; n++) {
+            struct cache_entry* next = cs->dirty[i + n];
+            if (next->ino != e->ino || next->offset != e->offset + n) break;
+        }
+        if (cache_write_run(cs, &cs->dirty[i], n) < 0) return -1;
+    }
+    return 0;
+}
+
+static int cache_flush_victim(struct cache_state* cs,
+                              struct cache_entry* victim) {
+    /* Write the victim together with the dirty blocks next to it, up to
+     * FLUSH_NBLOCKS blocks, instead of flushing the whole cache. */
+    struct cache_entry* e;
+    uint first = victim->offset, n;
+    for (n = 1; n < FLUSH_NBLOCKS && first > 0; n++, first--) {
+        e = cache_find(cs, victim->ino, first - 1);
+        if (e == NULL || !e->dirty) break;
+    }
+    for (n = 0; n < FLUSH_NBLOCKS; n++) {
+        e = cache_find(cs, victim->ino, first + n);
+        if (e == NULL || !e->dirty) break;
+        cs->dirty[n] = e;
+    }
+    return cache_write_run(cs, cs->dirty, n);
+}
+
+static struct cache_entry* cache_insert(struct cache_state* cs, uint ino,
+                                        uint offset) {
+    if (cs->free_list == NULL) {
+        struct cache_entry* victim = cs->lru.lru_prev;
+        if (victim->dirty && cache_flush_victim(cs, victim) < 0)
+            FATAL("cache_insert: fail to write back dirty blocks");
+        cs->stats.nevicts++;
+        cache_remove(cs, victim);
+    }
+
+    struct cache_entry** head = bucket(cs, ino, offset);
+    struct cache_entry* e     = cs->free_list;
+    cs->free_list             = e->hash_next;
+    e->ino                    = ino;
+    e->offset                 = offset;
+    e->dirty                  = 0;
+    e->hash_next              = *head;
+    *head                     = e;
+    lru_push(cs, e);
+    return e;
+}
+
+static int cachedisk_getsize(inode_intf self, uint ino) {
+    struct cache_state* cs = self->state;
+    return cs->below->getsize(cs->below, ino);
+}
+
+static int cachedisk_setsize(inode_intf self, uint ino, uint newsize) {
+    struct cache_state* cs = self->state;
+
+    /* Drop the cached blocks beyond the new size. */
+    for (struct cache_entry *e = cs->lru.lru_next, *next; e != &cs->lru;
+         e = next) {
+        next = e->lru_next;
+        if (e->ino == ino && e->offset >= newsize) cache_remove(cs, e);
+    }
+    return cs->below->setsize(cs->below, ino, newsize);
+}
+
+static int cachedisk_readv(inode_intf self, uint ino, uint offset,
+                           uint nblocks, block_t* blocks) {
+    struct cache_state* cs = self->state;
+    for (uint i = 0, n; i < nblocks; i += n) {
+        struct cache_entry* e = cache_lookup(cs, ino, offset + i);
+        if (e) {
+            cs->stats.nhits++;
+            memcpy(&blocks[i], &e->block, BLOCK_SIZE);
+            n = 1;
+            continue;
+        }
+
+        /* Read a run of blocks missing in the cache with one readv. */
+        for (n = 1; i + n < nblocks; n++)
+            if (cache_find(cs, ino, offset + i + n)) break;
+        if (cs->below->readv(cs->below, ino, offset + i, n, &blocks[i]) < 0)
+            return -1;
+
+        cs->stats.nmisses += n;
+        for (uint j = i; j < i + n; j++)
+            memcpy(&cache_insert(cs, ino, offset + j)->block, &blocks[j],
+                   BLOCK_SIZE);
+    }
+    return 0;
+}
+
+static int cachedisk_writev(inode_intf self, uint ino, uint offset,
+                            uint nblocks, block_t* blocks) {
+    struct cache_state* cs = self->state;
+    cs->stats.nwrites += nblocks;
+    if (cs->write_through) {
+        if (cs->below->writev(cs->below, ino, offset, nblocks, blocks) < 0)
+            return -1;
+        cs->stats.nwritebacks += nblocks;
+    }
+
+    for (uint i = 0; i < nblocks; i++) {
+        struct cache_entry* e = cache_lookup(cs, ino, offset + i);
+        if (e == NULL) e = cache_insert(cs, ino, offset + i);
+        memcpy(&e->block, &blocks[i], BLOCK_SIZE);
+        e->dirty = !cs->write_through;
+    }
+    return 0;
+}
+
+static int cachedisk_read(inode_intf self, uint ino, uint offset,
+                          block_t* block) {
+    return cachedisk_readv(self, ino, offset, 1, block);
+}
+
+static int cachedisk_write(inode_intf self, uint ino, uint offset,
+                           block_t* block) {
+    return cachedisk_writev(self, ino, offset, 1, block);
+}
+
+int cachedisk_sync(inode_intf self) {
+    struct cache_state* cs = self->state;
+    if (cache_flush(cs) < 0) return -1;
+    return cs->below->sync ? cs->below->sync(cs->below) : 0;
+}
+
+void cachedisk_get_stats(inode_intf self, struct cache_stats* stats) {
+    struct cache_state* cs = self->state;
+    *stats                 = cs->stats;
+}
+
+inode_intf cachedisk_init(inode_intf below, uint nblocks, uint write_through) {
+    struct cache_state* cs = malloc(sizeof(struct cache_state));
+    memset(cs, 0, sizeof(struct cache_state));
+    cs->below         = below;
+    cs->nbuckets      = nblocks;
+    cs->write_through = write_through;
+    cs->buckets       = calloc(nblocks, sizeof(struct cache_entry*));
+    cs->dirty         = malloc(nblocks * sizeof(struct cache_entry*));
+    cs->flush_buf     = malloc(FLUSH_NBLOCKS * sizeof(block_t));
+    cs->lru.lru_prev  = &cs->lru;
+    cs->lru.lru_next  = &cs->lru;
+    cs->stats.nblocks = nblocks;
+
+    struct cache_entry* entries = malloc(nblocks * sizeof(struct cache_entry));
+    for (uint i = 0; i < nblocks; i++) {
+        entries[i].hash_next = cs->free_list;
+        cs->free_list        = &entries[i];
+    }
+
+    inode_intf self = malloc(sizeof(struct inode_store));
+    memset(self, 0, sizeof(struct inode_store));
+    self->state   = cs;
+    self->getsize = cachedisk_getsize;
+    self->setsize = cachedisk_setsize;
+    self->read    = cachedisk_read;
+    self->write   = cachedisk_write;
+    self->readv   = cachedisk_readv;
+    self->writev  = cachedisk_writev;
+    self->sync    = cachedisk_sync;
+    return self;
+}
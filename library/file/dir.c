@@ -0,0 +1,88 @@
+/*
+ * (C) 2025, Cornell University
+ * All rights reserved.
+ *
+ * Description: the hashed directory format
+ * dir_find() looks up a name in a directory file and dir_find_path() a
+ * path for GPID_FILE, and dir_insert() adds a name to the blocks of a
+ * directory for mkfs.
+ */
+
+#ifdef MKFS
+#include <sys/types.h>
+#else
+#include "egos.h"
+#endif
+
+#include "dir.h"
+#include <string.h>
+
+uint dir_hash(char* name) {
+    /* The 32-bit FNV-1a hash function. */
+    uint hash = 2166136261u;
+    for (; *name; name++) hash = (hash ^ (unsigned char)*name) * 16777619u;
+    return hash;
+}
+
+int dir_find(inode_intf fs, uint dir_ino, char* name) {
+    int nblocks = fs->getsize(fs, dir_ino);
+    if (nblocks <= 0 || strlen(name) >= DIR_NAME_LEN) return -1;
+
+    struct dir_block block;
+    uint start = dir_hash(name) % nblocks;
+    for (uint i = 0; i < nblocks; i++) {
+        if (fs->read(fs, dir_ino, (start + i) % nblocks, (void*)&block) < 0)
+            return -1;
+        for (uint j = 0; j < DIR_ENTRIES_PER_BLOCK; j++) {
+            struct dir_entry* e = &block.entries[j];
+            if (e->name[0] == 0) return -1;
+            if (strcmp(e->name, name) == 0) return e->ino;
+        }
+    }
+    return -1;
+}
+
+int dir_find_path(inode_intf fs, uint dir_ino, char* path, dir_finder find) {
+    /* Look up the components one by one; A directory name in a directory
+     * ends with '/', which can be omitted for the last component. */
+    int ino = (path[0] == '/') ? 0 : dir_ino;
+    char name[DIR_NAME_LEN];
+    for (char* s = path; ino >= 0 && *s;) {
+        uint len = strcspn(s, "/");
+        if (len == 0) {
+            s++;
+            continue;
+        }
+        if (len + 1 >= DIR_NAME_LEN) return -1;
+
+        memcpy(name, s, len);
+        strcpy(name + len, "/");
+        s += len;
+        if (*s == 0) {
+            name[len] = 0;
+            int file_ino = find(fs, ino, name);
+            if (file_ino >= 0) return file_ino;
+            name[len] = '/';
+        }
+        ino = find(fs, ino, name);
+    }
+    return ino;
+}
+
+int dir_insert(struct dir_block* blocks, uint nblocks, char* name, uint ino) {
+    if (strlen(name) >= DIR_NAME_LEN) return -1;
+
+    uint start = dir_hash(name) % nblocks;
+    for (uint i = 0; i < nblocks; i++) {
+        struct dir_block* block = &blocks[(start + i) % nblocks];
+        for (uint j = 0; j < DIR_ENTRIES_PER_BLOCK; j++) {
+            struct dir_entry* e = &block->entries[j];
+            if (e->name[0] == 0) {
+                strcpy(e->name, name);
+                e->ino = ino;
+                return 0;
+            }
+        }
+    }
+    return -1;
+}
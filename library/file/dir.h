@@ -0,0 +1,28 @@
+#pragma once
+
+/* A directory is a file of dir_block blocks, and an entry for a name is
+ * kept in block dir_hash(name) % nblocks, or in one of the blocks after it
+ * (wrapping around) if that block is full. A lookup thus stops at the first
+ * block which has the name or an empty entry. mkfs keeps the directories at
+ * most half full, so a lookup usually reads one block. Names of directories
+ * end with a '/', e.g., "home/" and "../". */
+#include "inode.h"
+
+#define DIR_NAME_LEN          28 /* including the null character */
+#define DIR_ENTRIES_PER_BLOCK (BLOCK_SIZE / sizeof(struct dir_entry))
+
+struct dir_entry {
+    char name[DIR_NAME_LEN]; /* empty if name[0] == 0 */
+    uint ino;
+};
+
+struct dir_block {
+    struct dir_entry entries[DIR_ENTRIES_PER_BLOCK];
+};
+
+typedef int (*dir_finder)(inode_intf fs, uint dir_ino, char* name);
+
+uint dir_hash(char* name);
+int dir_find(inode_intf fs, uint dir_ino, char* name);
+int dir_find_path(inode_intf fs, uint dir_ino, char* path, dir_finder find);
+int dir_insert(struct dir_block* blocks, uint nblocks, char* name, uint ino);
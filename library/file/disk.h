@@ -6,6 +6,20 @@ typedef struct block {
     char bytes[BLOCK_SIZE];
 } block_t;
 
+/* A request for earth->disk_submit(); The kernel polls the disk with
+ * earth->disk_poll() and sets status to DISK_DONE when the request is served.
+ * Since the request is served in the background, buf must be a physical
+ * address which is not in the user address space (e.g., a page from
+ * earth->mmu_alloc() which is not mapped by earth->mmu_map()). */
+struct disk_request {
+    enum { DISK_READ, DISK_WRITE } type;
+    enum { DISK_NEW, DISK_QUEUED, DISK_DONE } status;
+    uint block_no, nblocks;
+    char* buf;
+    struct disk_request* next; /* used by the disk driver */
+    uint nbypass;              /* used by the disk driver */
+};
+
 #define SIZE_2MB             (2 * 1024 * 1024)
 #define EGOS_BIN_DISK_SIZE   SIZE_2MB
 #define FILE_SYS_DISK_SIZE   SIZE_2MB
@@ -43,6 +43,25 @@ int mydisk_write(inode_intf self, uint ino, uint offset, block_t* block) {
     /* Student's code ends here. */
 }
 
+int mydisk_readv(inode_intf self, uint ino, uint offset, uint nblocks,
+                 block_t* blocks) {
+    for (uint i = 0; i < nblocks; i++)
+        if (self->read(self, ino, offset + i, blocks + i) < 0) return -1;
+    return 0;
+}
+
+int mydisk_writev(inode_intf self, uint ino, uint offset, uint nblocks,
+                  block_t* blocks) {
+    for (uint i = 0; i < nblocks; i++)
+        if (self->write(self, ino, offset + i, blocks + i) < 0) return -1;
+    return 0;
+}
+
+int mydisk_sync(inode_intf self) {
+    inode_intf below = self->state;
+    return below->sync ? below->sync(below) : 0;
+}
+
 int mydisk_getsize(inode_intf self, uint ino) {
     /* Student's code goes here (File System). */
 
@@ -87,6 +106,9 @@ inode_intf mydisk_init(inode_intf below, uint below_ino) {
     self->setsize   = mydisk_setsize;
     self->read      = mydisk_read;
     self->write     = mydisk_write;
+    self->readv     = mydisk_readv;
+    self->writev    = mydisk_writev;
+    self->sync      = mydisk_sync;
     self->state     = below;
     return self;
     /* Student's code ends here. */
@@ -45,14 +45,64 @@ struct treedisk_snapshot {
     union treedisk_block inodeblock;
     block_no inode_blockno;
     struct treedisk_inode* inode;
+    uint inode_slot; /* index of the inode in its inode block */
 };
 
 /* The state of a virtual inode store, which is identified by an inode number.
+ * The superblock, the inode blocks and the tree height of every inode are
+ * cached here, so a read does not have to read them from the store below.
+ * The inode block cache is direct-mapped and holds all the inode blocks of
+ * NINODES inodes, also with inline data (INLINE_INODES_PER_BLOCK inodes in
+ * a block). All the writes below, except for data blocks, go through
+ * treedisk_write_block(), which keeps the cached blocks up to date.
  */
+#define INODEBLOCK_CACHE_SIZE (NINODES / INLINE_INODES_PER_BLOCK)
+#define INODEBLOCK_SLOT(b)    (((b) - 1) % INODEBLOCK_CACHE_SIZE)
+#define RESERVE_NBLOCKS       REFS_PER_BLOCK
+#define TXN_NBLOCKS           16 /* most blocks logged by one write */
+
+/* The format of the file systems created by treedisk_create().
+ */
+#ifndef TREEDISK_VERSION
+#define TREEDISK_VERSION TREEDISK_BITMAP
+#endif
+
 struct treedisk_state {
     inode_intf below; /* inode store below */
     uint below_ino;   /* inode number to use for the inode store below */
     uint ninodes;     /* number of inodes in the treedisk */
+
+    uint superblock_valid;           /* whether superblock is cached */
+    union treedisk_block superblock; /* cached superblock */
+    struct {
+        block_no blockno; /* 0 means unused (block 0 is the superblock) */
+        union treedisk_block block;
+    } inodeblocks[INODEBLOCK_CACHE_SIZE]; /* see INODEBLOCK_SLOT() */
+    struct {
+        block_no nblocks; /* tree height of an inode with nblocks blocks */
+        uint nlevels;
+    } heights[NINODES];
+
+    /* Data blocks taken from the free list for the file being extended by
+     * treedisk_writev(), so that its blocks are not interleaved with the
+     * indirect blocks.
+     */
+    block_no reserved[RESERVE_NBLOCKS];
+    uint reserve_next, reserve_end;
+
+    /* In-memory copy of the bitmap (TREEDISK_BITMAP only).  The bitmap
+     * blocks in [bitmap_dirty_lo, bitmap_dirty_hi) have not been written
+     * back yet, and the search for free blocks starts at alloc_hint.
+     */
+    block_no* bitmap;
+    uint bitmap_dirty_lo, bitmap_dirty_hi;
+    block_no alloc_hint;
+
+    /* The blocks logged since the last commit, if the file system has a
+     * log.  log[0] is the log header and log[1 .. log_n] are the blocks.
+     */
+    block_t* log;
+    uint log_n;
 };
 
 static uint log_rpb;       /* log2(REFS_PER_BLOCK) */
@@ -77,21 +127,181 @@ static block_no log_shift_r(block_no x, uint nbits) {
     return x >> nbits;
 }
 
+/* Compute the number of levels of indirect blocks of an inode with nblocks
+ * blocks, which is cached for every inode.
+ */
+static uint treedisk_nlevels(struct treedisk_state* ts, uint inode_no,
+                             block_no nblocks) {
+    if (inode_no < NINODES && ts->heights[inode_no].nblocks == nblocks)
+        return ts->heights[inode_no].nlevels;
+
+    uint nlevels = 0;
+    if (nblocks > 0)
+        while (log_shift_r(nblocks - 1, nlevels * log_rpb) != 0) {
+            nlevels++;
+        }
+
+    if (inode_no < NINODES) {
+        ts->heights[inode_no].nblocks = nblocks;
+        ts->heights[inode_no].nlevels = nlevels;
+    }
+    return nlevels;
+}
+
+/* Return the checksum of the log header and the n blocks in log[].
+ */
+static block_no treedisk_log_checksum(block_t* log, uint n) {
+    struct treedisk_logheader* header = (struct treedisk_logheader*)log;
+    block_no sum                      = n;
+    for (uint i = 0; i < n; i++) {
+        block_no* words = (block_no*)&log[1 + i];
+        sum             = sum * 31 + header->home[i];
+        for (uint j = 0; j < REFS_PER_BLOCK; j++) sum = sum * 31 + words[j];
+    }
+    return sum;
+}
+
+/* Commit the blocks logged since the last commit with one writev.  The
+ * store below is synced before, so that the data blocks and the home
+ * locations of the last commit are on disk before the log is overwritten,
+ * and after.  The blocks are then written to their home locations, which
+ * reach the disk by the next commit at the latest.
+ */
+static int treedisk_commit(struct treedisk_state* ts) {
+    inode_intf below = ts->below;
+    if (ts->log_n == 0) return 0;
+    if (below->sync && (*below->sync)(below) < 0) return -1;
+
+    struct treedisk_superblock* sb    = &ts->superblock.superblock;
+    struct treedisk_logheader* header = (struct treedisk_logheader*)ts->log;
+    block_no start   = 1 + sb->n_inodeblocks + sb->n_bitmapblocks;
+    header->nblocks  = ts->log_n;
+    header->checksum = treedisk_log_checksum(ts->log, ts->log_n);
+    if ((*below->writev)(below, ts->below_ino, start, 1 + ts->log_n,
+                         ts->log) < 0)
+        return -1;
+    if (below->sync && (*below->sync)(below) < 0) return -1;
+
+    for (uint i = 0; i < ts->log_n; i++)
+        if ((*below->write)(below, ts->below_ino, header->home[i],
+                            &ts->log[1 + i]) < 0)
+            return -1;
+    ts->log_n = 0;
+    return 0;
+}
+
+/* Replay the last commit in the log when the file system is opened, unless
+ * it is torn: write the logged blocks to their home locations again.
+ */
+static int treedisk_replay(struct treedisk_state* ts) {
+    inode_intf below               = ts->below;
+    struct treedisk_superblock* sb = &ts->superblock.superblock;
+    block_no start = 1 + sb->n_inodeblocks + sb->n_bitmapblocks;
+
+    if (ts->log == 0) ts->log = malloc(LOG_NBLOCKS * BLOCK_SIZE);
+    struct treedisk_logheader* header = (struct treedisk_logheader*)ts->log;
+    if ((*below->read)(below, ts->below_ino, start, ts->log) < 0) return -1;
+
+    uint n = header->nblocks;
+    if (n == 0 || n >= LOG_NBLOCKS) return 0;
+    if ((*below->readv)(below, ts->below_ino, start + 1, n, &ts->log[1]) < 0)
+        return -1;
+    if (treedisk_log_checksum(ts->log, n) != header->checksum) return 0;
+
+    for (uint i = 0; i < n; i++)
+        if ((*below->write)(below, ts->below_ino, header->home[i],
+                            &ts->log[1 + i]) < 0)
+            return -1;
+    return below->sync ? (*below->sync)(below) : 0;
+}
+
+/* Start a write.  Commit first if the log may not have room for all the
+ * blocks logged by the write.
+ */
+static int treedisk_begin(struct treedisk_state* ts) {
+    if (ts->log && ts->log_n + TXN_NBLOCKS > LOG_NBLOCKS - 1)
+        return treedisk_commit(ts);
+    return 0;
+}
+
+/* Read block b from the log if it was logged since the last commit, or
+ * otherwise from the inode store below.
+ */
+static int treedisk_read_block(struct treedisk_state* ts, block_no b,
+                               block_t* block) {
+    struct treedisk_logheader* header = (struct treedisk_logheader*)ts->log;
+    for (uint i = 0; i < ts->log_n; i++)
+        if (header->home[i] == b) {
+            memcpy(block, &ts->log[1 + i], BLOCK_SIZE);
+            return 0;
+        }
+    return (*ts->below->read)(ts->below, ts->below_ino, b, block);
+}
+
+/* Write a block to the log if the file system has one, or to the inode
+ * store below otherwise, and update the cached copy.
+ */
+static int treedisk_write_block(struct treedisk_state* ts, block_no b,
+                                block_t* block) {
+    if (ts->log) {
+        struct treedisk_logheader* header = (struct treedisk_logheader*)ts->log;
+        uint i = 0;
+        while (i < ts->log_n && header->home[i] != b) i++;
+
+        /* A write logging more than TXN_NBLOCKS blocks commits halfway. */
+        if (i == LOG_NBLOCKS - 1) {
+            if (treedisk_commit(ts) < 0) return -1;
+            i = 0;
+        }
+        if (i == ts->log_n) header->home[ts->log_n++] = b;
+        memcpy(&ts->log[1 + i], block, BLOCK_SIZE);
+    } else if ((*ts->below->write)(ts->below, ts->below_ino, b, block) < 0) {
+        return -1;
+    }
+
+    if (b == 0 && ts->superblock_valid)
+        memcpy(&ts->superblock, block, BLOCK_SIZE);
+    if (b != 0 && ts->inodeblocks[INODEBLOCK_SLOT(b)].blockno == b)
+        memcpy(&ts->inodeblocks[INODEBLOCK_SLOT(b)].block, block, BLOCK_SIZE);
+    return 0;
+}
+
 /* Get a snapshot of the file system, including the superblock and the block
- * containing the inode, from the inode store below.
+ * containing the inode, from the cache or the inode store below.
  */
 static int treedisk_get_snapshot(struct treedisk_snapshot* snapshot,
                                  struct treedisk_state* ts, uint inode_no) {
     /* Get the superblock.
      */
-    if ((*ts->below->read)(ts->below, ts->below_ino, 0,
-                           (block_t*)&snapshot->superblock) < 0)
-        return -1;
+    if (!ts->superblock_valid) {
+        if ((*ts->below->read)(ts->below, ts->below_ino, 0,
+                               (block_t*)&ts->superblock) < 0)
+            return -1;
+        if (ts->superblock.superblock.n_logblocks && treedisk_replay(ts) < 0)
+            return -1;
+        ts->superblock_valid = 1;
+    }
+    snapshot->superblock = ts->superblock;
+
+    /* Load the bitmap the first time.
+     */
+    struct treedisk_superblock* sb = &snapshot->superblock.superblock;
+    if (sb->version == TREEDISK_BITMAP && ts->bitmap == 0) {
+        ts->bitmap = malloc(sb->n_bitmapblocks * BLOCK_SIZE);
+        if ((*ts->below->readv)(ts->below, ts->below_ino,
+                                1 + sb->n_inodeblocks, sb->n_bitmapblocks,
+                                (block_t*)ts->bitmap) < 0) {
+            free(ts->bitmap);
+            ts->bitmap = 0;
+            return -1;
+        }
+    }
 
     /* Check the inode number.
      */
-    if (inode_no >=
-        snapshot->superblock.superblock.n_inodeblocks * INODES_PER_BLOCK) {
+    uint per_block = sb->inline_data ? INLINE_INODES_PER_BLOCK
+                                     : INODES_PER_BLOCK;
+    if (inode_no >= sb->n_inodeblocks * per_block) {
         printf("!!TDERR: inode number too large %u %u\n", inode_no,
                snapshot->superblock.superblock.n_inodeblocks);
         return -1;
@@ -99,20 +309,81 @@ static int treedisk_get_snapshot(struct treedisk_snapshot* snapshot,
 
     /* Find the inode.
      */
-    snapshot->inode_blockno = 1 + inode_no / INODES_PER_BLOCK;
-    if ((*ts->below->read)(ts->below, ts->below_ino, snapshot->inode_blockno,
-                           (block_t*)&snapshot->inodeblock) < 0)
+    snapshot->inode_blockno = 1 + inode_no / per_block;
+    uint i = INODEBLOCK_SLOT(snapshot->inode_blockno);
+    if (ts->inodeblocks[i].blockno == snapshot->inode_blockno) {
+        snapshot->inodeblock = ts->inodeblocks[i].block;
+    } else {
+        /* Read into the snapshot before caching the block, so that a read
+         * which waits for the disk never leaves a half-filled cache entry.
+         */
+        if (treedisk_read_block(ts, snapshot->inode_blockno,
+                                (block_t*)&snapshot->inodeblock) < 0)
+            return -1;
+        ts->inodeblocks[i].blockno = snapshot->inode_blockno;
+        ts->inodeblocks[i].block   = snapshot->inodeblock;
+    }
+
+    snapshot->inode_slot = inode_no % per_block;
+    snapshot->inode      =
+        &snapshot->inodeblock.inodeblock.inodes[snapshot->inode_slot];
+    return 0;
+}
+
+/* See if the file of the snapshot is an inline file.
+ */
+static int treedisk_is_inline(struct treedisk_snapshot* snapshot) {
+    return snapshot->superblock.superblock.inline_data &&
+           snapshot->inode->nblocks == 1 && snapshot->inode->root == 0;
+}
+
+/* Return the offset of the inline bytes of inode 'slot' in the inode block.
+ */
+static uint treedisk_inline_offset(struct treedisk_inlineblock* ib,
+                                   uint slot) {
+    uint offset = 0;
+    for (uint i = 0; i < slot; i++) offset += ib->inline_len[i];
+    return offset;
+}
+
+/* Copy the inline file of the snapshot into *block.
+ */
+static void treedisk_get_inline(struct treedisk_snapshot* snapshot,
+                                block_t* block) {
+    struct treedisk_inlineblock* ib = &snapshot->inodeblock.inlineblock;
+    uint slot                       = snapshot->inode_slot;
+    memset(block, 0, BLOCK_SIZE);
+    memcpy(block, &ib->data[treedisk_inline_offset(ib, slot)],
+           ib->inline_len[slot]);
+}
+
+/* Replace the inline bytes of the inode in the snapshot with the leading
+ * bytes of *block up to the last non-null byte, moving the inline bytes of
+ * the following inodes.  Return -1 if they do not fit in the inode block.
+ */
+static int treedisk_set_inline(struct treedisk_snapshot* snapshot,
+                               block_t* block) {
+    struct treedisk_inlineblock* ib = &snapshot->inodeblock.inlineblock;
+    uint slot = snapshot->inode_slot;
+
+    uint len = BLOCK_SIZE;
+    while (len > 0 && block->bytes[len - 1] == 0) len--;
+    uint offset = treedisk_inline_offset(ib, slot);
+    uint total  = treedisk_inline_offset(ib, INLINE_INODES_PER_BLOCK);
+    if (total - ib->inline_len[slot] + len > INLINE_BYTES_PER_BLOCK)
         return -1;
 
-    snapshot->inode =
-        &snapshot->inodeblock.inodeblock.inodes[inode_no % INODES_PER_BLOCK];
+    memmove(&ib->data[offset + len], &ib->data[offset + ib->inline_len[slot]],
+            total - offset - ib->inline_len[slot]);
+    memcpy(&ib->data[offset], block, len);
+    ib->inline_len[slot] = len;
     return 0;
 }
 
-/* Allocate a block from the free list.
+/* Allocate a block from the free list (TREEDISK_FREELIST).
  */
-static block_no treedisk_alloc_block(struct treedisk_state* ts,
-                                     struct treedisk_snapshot* snapshot) {
+static block_no treedisk_alloc_freelist(struct treedisk_state* ts,
+                                        struct treedisk_snapshot* snapshot) {
     block_no b;
 
     if ((b = snapshot->superblock.superblock.free_list) == 0)
@@ -121,8 +392,7 @@ static block_no treedisk_alloc_block(struct treedisk_state* ts,
     /* Read the freelist block and scan for a free block reference.
      */
     union treedisk_block freelistblock;
-    if ((*ts->below->read)(ts->below, ts->below_ino, b,
-                           (block_t*)&freelistblock) < 0) {
+    if (treedisk_read_block(ts, b, (block_t*)&freelistblock) < 0) {
         panic("treedisk_alloc_block");
     }
     uint i;
@@ -139,15 +409,14 @@ static block_no treedisk_alloc_block(struct treedisk_state* ts,
         free_blockno = b;
         snapshot->superblock.superblock.free_list =
             freelistblock.freelistblock.refs[0];
-        if ((*ts->below->write)(ts->below, ts->below_ino, 0,
-                                (block_t*)&snapshot->superblock) < 0) {
+        block_t* superblock = (block_t*)&snapshot->superblock;
+        if (treedisk_write_block(ts, 0, superblock) < 0) {
             panic("treedisk_alloc_block: superblock");
         }
     } else {
         free_blockno = freelistblock.freelistblock.refs[i];
         freelistblock.freelistblock.refs[i] = 0;
-        if ((*ts->below->write)(ts->below, ts->below_ino, b,
-                                (block_t*)&freelistblock) < 0) {
+        if (treedisk_write_block(ts, b, (block_t*)&freelistblock) < 0) {
             panic("treedisk_alloc_block: freelistblock");
         }
     }
@@ -155,6 +424,99 @@ static block_no treedisk_alloc_block(struct treedisk_state* ts,
     return free_blockno;
 }
 
+/* Set the bit of block b in the in-memory bitmap to 'used'.
+ */
+static void treedisk_bitmap_set(struct treedisk_state* ts, block_no b,
+                                uint used) {
+    if (used)
+        ts->bitmap[b / 32] |= 1U << (b % 32);
+    else
+        ts->bitmap[b / 32] &= ~(1U << (b % 32));
+
+    uint bitmap_blockno = b / BITS_PER_BLOCK;
+    if (ts->bitmap_dirty_lo >= ts->bitmap_dirty_hi) {
+        ts->bitmap_dirty_lo = bitmap_blockno;
+        ts->bitmap_dirty_hi = bitmap_blockno + 1;
+    } else if (bitmap_blockno < ts->bitmap_dirty_lo) {
+        ts->bitmap_dirty_lo = bitmap_blockno;
+    } else if (bitmap_blockno >= ts->bitmap_dirty_hi) {
+        ts->bitmap_dirty_hi = bitmap_blockno + 1;
+    }
+}
+
+/* Allocate 'n' blocks into blocks[], in ascending order from alloc_hint if
+ * the file system has a bitmap.  The bitmap is only updated in memory; See
+ * treedisk_sync_bitmap().
+ */
+static void treedisk_alloc_blocks(struct treedisk_state* ts,
+                                  struct treedisk_snapshot* snapshot, uint n,
+                                  block_no* blocks) {
+    struct treedisk_superblock* sb = &snapshot->superblock.superblock;
+    if (sb->version != TREEDISK_BITMAP) {
+        for (uint i = 0; i < n; i++)
+            blocks[i] = treedisk_alloc_freelist(ts, snapshot);
+        return;
+    }
+
+    block_no b = ts->alloc_hint;
+    for (uint i = 0, nscanned = 0; i < n; b = (b + 1) % sb->nblocks) {
+        if (nscanned++ >= sb->nblocks)
+            panic("treedisk_alloc_blocks: inode store is full\n");
+
+        /* Skip a word of 32 blocks in use at once.
+         */
+        block_no* word = &ts->bitmap[b / 32];
+        if (b % 32 == 0 && *word == ~0U && b + 32 <= sb->nblocks) {
+            b += 31;
+            nscanned += 31;
+            continue;
+        }
+        if (*word & (1U << (b % 32))) continue;
+
+        treedisk_bitmap_set(ts, b, 1);
+        blocks[i++] = b;
+    }
+    ts->alloc_hint = b;
+}
+
+/* Write the dirty bitmap blocks back with one writev.
+ */
+static int treedisk_sync_bitmap(struct treedisk_state* ts) {
+    uint lo = ts->bitmap_dirty_lo, hi = ts->bitmap_dirty_hi;
+    if (lo >= hi) return 0;
+
+    block_no first  = 1 + ts->superblock.superblock.n_inodeblocks + lo;
+    block_t* bitmap = (block_t*)ts->bitmap;
+    if (ts->log) {
+        for (uint i = lo; i < hi; i++)
+            if (treedisk_write_block(ts, first + i - lo, &bitmap[i]) < 0)
+                return -1;
+    } else if ((*ts->below->writev)(ts->below, ts->below_ino, first, hi - lo,
+                                    &bitmap[lo]) < 0) {
+        return -1;
+    }
+    ts->bitmap_dirty_lo = ts->bitmap_dirty_hi = 0;
+    return 0;
+}
+
+/* Allocate one block.
+ */
+static block_no treedisk_alloc_block(struct treedisk_state* ts,
+                                     struct treedisk_snapshot* snapshot) {
+    block_no b;
+    treedisk_alloc_blocks(ts, snapshot, 1, &b);
+    return b;
+}
+
+/* Allocate a data block from the reserved blocks or the free list.
+ */
+static block_no treedisk_alloc_data(struct treedisk_state* ts,
+                                    struct treedisk_snapshot* snapshot) {
+    if (ts->reserve_next < ts->reserve_end)
+        return ts->reserved[ts->reserve_next++];
+    return treedisk_alloc_block(ts, snapshot);
+}
+
 /* Retrieve the number of blocks in the file referenced by 'self'.  This
  * information is maintained in the inode itself.
  */
@@ -192,14 +554,16 @@ static int treedisk_read(inode_intf self, uint ino, block_no offset,
         return -1;
     }
 
+    /* The bytes of an inline file are in the inode block.
+     */
+    if (treedisk_is_inline(&snapshot)) {
+        treedisk_get_inline(&snapshot, block);
+        return 0;
+    }
+
     /* Figure out how many levels there are in the tree.
      */
-    uint nlevels = 0;
-    if (snapshot.inode->nblocks > 0)
-        while (log_shift_r(snapshot.inode->nblocks - 1, nlevels * log_rpb) !=
-               0) {
-            nlevels++;
-        }
+    uint nlevels = treedisk_nlevels(ts, ino, snapshot.inode->nblocks);
 
     /* Walk down from the root block.
      */
@@ -214,7 +578,7 @@ static int treedisk_read(inode_intf self, uint ino, block_no offset,
 
         /* Return the next level.  If the last level, we're done.
          */
-        int result = (*ts->below->read)(ts->below, ts->below_ino, b, block);
+        int result = treedisk_read_block(ts, b, block);
         if (result < 0) return result;
         if (nlevels == 0) return 0;
 
@@ -229,10 +593,88 @@ static int treedisk_read(inode_intf self, uint ino, block_no offset,
     return 0;
 }
 
-/* Write *block at the given block number 'offset'.
+/* Read the bottom-level indirect block on the path to the data block at
+ * 'offset' (nlevels >= 1) into *leaf.  A hole is returned as a null block.
  */
-static int treedisk_write(inode_intf self, uint ino, block_no offset,
-                          block_t* block) {
+static int treedisk_read_leaf(struct treedisk_state* ts, block_no root,
+                              uint nlevels, block_no offset,
+                              struct treedisk_indirblock* leaf) {
+    block_no b = root;
+    for (; nlevels > 1 && b != 0; nlevels--) {
+        if (treedisk_read_block(ts, b, (block_t*)leaf) < 0) return -1;
+        uint index = log_shift_r(offset, (nlevels - 1) * log_rpb) %
+                     REFS_PER_BLOCK;
+        b          = leaf->refs[index];
+    }
+
+    if (b == 0) {
+        memset(leaf, 0, BLOCK_SIZE);
+        return 0;
+    }
+    return treedisk_read_block(ts, b, (block_t*)leaf);
+}
+
+/* Read 'nblocks' blocks starting at block number 'offset' into blocks[].
+ * The indirect blocks are read once for all the data blocks below them, and
+ * a run of consecutive data blocks is read with one readv of the store below.
+ */
+static int treedisk_readv(inode_intf self, uint ino, block_no offset,
+                          uint nblocks, block_t* blocks) {
+    struct treedisk_state* ts = self->state;
+
+    struct treedisk_snapshot snapshot;
+    if (treedisk_get_snapshot(&snapshot, ts, ino) < 0) return -1;
+
+    if (offset + nblocks > snapshot.inode->nblocks) {
+        printf("!!TDERR: offset too large %u %u\n", offset + nblocks,
+               snapshot.inode->nblocks);
+        return -1;
+    }
+
+    uint nlevels = treedisk_nlevels(ts, ino, snapshot.inode->nblocks);
+    if (nblocks == 0) return 0;
+    if (nlevels == 0) return treedisk_read(self, ino, offset, blocks);
+
+    /* Walk through the data blocks, reading a new bottom-level indirect
+     * block every REFS_PER_BLOCK blocks.  [run_start, run_start + run_len)
+     * are the consecutive data blocks not read yet.
+     */
+    struct treedisk_indirblock leaf;
+    block_no run_start = 0;
+    uint run_len = 0, run_index = 0;
+    for (uint i = 0; i <= nblocks; i++) {
+        block_no b = 0;
+        if (i < nblocks) {
+            if (i == 0 || (offset + i) % REFS_PER_BLOCK == 0)
+                if (treedisk_read_leaf(ts, snapshot.inode->root, nlevels,
+                                       offset + i, &leaf) < 0)
+                    return -1;
+            b = leaf.refs[(offset + i) % REFS_PER_BLOCK];
+            if (b == 0) memset(&blocks[i], 0, BLOCK_SIZE);
+        }
+
+        if (run_len > 0 && b == run_start + run_len) {
+            run_len++;
+            continue;
+        }
+        if (run_len > 0 && (*ts->below->readv)(ts->below, ts->below_ino,
+                                               run_start, run_len,
+                                               &blocks[run_index]) < 0)
+            return -1;
+
+        run_start = b;
+        run_len   = (b != 0);
+        run_index = i;
+    }
+    return 0;
+}
+
+/* Write *block at the given block number 'offset', leaving the bitmap
+ * blocks dirty.  If 'may_inline' is set and the file has one block, the
+ * file is kept in the inode block if it fits.
+ */
+static int treedisk_write_one(inode_intf self, uint ino, block_no offset,
+                              block_t* block, uint may_inline) {
     struct treedisk_state* ts = self->state;
     uint dirty_inode          = 0;
 
@@ -242,14 +684,35 @@ static int treedisk_write(inode_intf self, uint ino, block_no offset,
     struct treedisk_snapshot* snapshot = &snapshot_buffer;
     if (treedisk_get_snapshot(snapshot, ts, ino) < 0) return -1;
 
-    /* Figure out how many levels there are in the tree now.
+    /* Write an inline file, or move the bytes of an inline file to a data
+     * block if it does not fit or grows beyond one block.
      */
-    uint nlevels = 0;
-    if (snapshot->inode->nblocks > 0)
-        while (log_shift_r(snapshot->inode->nblocks - 1, nlevels * log_rpb) !=
-               0) {
-            nlevels++;
+    struct treedisk_inode* inode = snapshot->inode;
+    if (snapshot->superblock.superblock.inline_data) {
+        if (may_inline && offset == 0 && inode->nblocks <= 1 &&
+            treedisk_set_inline(snapshot, block) == 0) {
+            if (inode->root != 0) treedisk_bitmap_set(ts, inode->root, 0);
+            inode->root    = 0;
+            inode->nblocks = 1;
+            return treedisk_write_block(ts, snapshot->inode_blockno,
+                                        (block_t*)&snapshot->inodeblock);
+        }
+
+        if (treedisk_is_inline(snapshot)) {
+            block_t data;
+            treedisk_get_inline(snapshot, &data);
+            treedisk_set_inline(snapshot, &null_block);
+            inode->root = treedisk_alloc_block(ts, snapshot);
+            dirty_inode = 1;
+            if ((*ts->below->write)(ts->below, ts->below_ino, inode->root,
+                                    &data) < 0)
+                panic("treedisk_write: inline block");
         }
+    }
+
+    /* Figure out how many levels there are in the tree now.
+     */
+    uint nlevels = treedisk_nlevels(ts, ino, snapshot->inode->nblocks);
 
     /* Figure out how many levels we need after writing.  Files cannot shrink
      * by writing.
@@ -258,10 +721,7 @@ static int treedisk_write(inode_intf self, uint ino, block_no offset,
     if (offset >= snapshot->inode->nblocks) {
         snapshot->inode->nblocks = offset + 1;
         dirty_inode              = 1;
-        nlevels_after            = 0;
-        while (log_shift_r(offset, nlevels_after * log_rpb) != 0) {
-            nlevels_after++;
-        }
+        nlevels_after            = treedisk_nlevels(ts, ino, offset + 1);
     } else {
         nlevels_after = nlevels;
     }
@@ -281,8 +741,7 @@ static int treedisk_write(inode_intf self, uint ino, block_no offset,
             tib.refs[0]           = snapshot->inode->root;
             snapshot->inode->root = indir;
             dirty_inode           = 1;
-            if ((*ts->below->write)(ts->below, ts->below_ino, indir,
-                                    (block_t*)&tib) < 0) {
+            if (treedisk_write_block(ts, indir, (block_t*)&tib) < 0) {
                 panic("treedisk_write: indirect block");
             }
 
@@ -293,9 +752,8 @@ static int treedisk_write(inode_intf self, uint ino, block_no offset,
     /* If the inode block was updated, write it back now.
      */
     if (dirty_inode)
-        if ((*ts->below->write)(ts->below, ts->below_ino,
-                                snapshot->inode_blockno,
-                                (block_t*)&snapshot->inodeblock) < 0) {
+        if (treedisk_write_block(ts, snapshot->inode_blockno,
+                                 (block_t*)&snapshot->inodeblock) < 0) {
             panic("treedisk_write: inode block");
         }
 
@@ -311,16 +769,16 @@ static int treedisk_write(inode_intf self, uint ino, block_no offset,
          */
         struct treedisk_indirblock tib;
         if ((b = *parent_no) == 0) {
-            b = *parent_no = treedisk_alloc_block(ts, snapshot);
-            if ((*ts->below->write)(ts->below, ts->below_ino, parent_off,
-                                    parent_block) < 0)
+            b = *parent_no = (nlevels == 0)
+                                 ? treedisk_alloc_data(ts, snapshot)
+                                 : treedisk_alloc_block(ts, snapshot);
+            if (treedisk_write_block(ts, parent_off, parent_block) < 0)
                 panic("treedisk_write: parent");
             if (nlevels == 0) break;
             memset(&tib, 0, BLOCK_SIZE);
         } else {
             if (nlevels == 0) break;
-            if ((*ts->below->read)(ts->below, ts->below_ino, b,
-                                   (block_t*)&tib) < 0)
+            if (treedisk_read_block(ts, b, (block_t*)&tib) < 0)
                 panic("treedisk_write");
         }
 
@@ -338,6 +796,65 @@ static int treedisk_write(inode_intf self, uint ino, block_no offset,
     return 0;
 }
 
+/* Write *block at the given block number 'offset'.
+ */
+static int treedisk_write(inode_intf self, uint ino, block_no offset,
+                          block_t* block) {
+    if (treedisk_begin(self->state) < 0) return -1;
+    if (treedisk_write_one(self, ino, offset, block, 1) < 0) return -1;
+    return treedisk_sync_bitmap(self->state);
+}
+
+/* Write blocks[] at the 'nblocks' blocks starting at block number 'offset'.
+ * Before extending the file, allocate the new data blocks in a row.  Both
+ * the bitmap and the free list (see setup_freelist()) hand out blocks in
+ * ascending order, so the data blocks form a contiguous run.  The bitmap
+ * blocks are written back once for every RESERVE_NBLOCKS blocks.
+ */
+static int treedisk_writev(inode_intf self, uint ino, block_no offset,
+                           uint nblocks, block_t* blocks) {
+    struct treedisk_state* ts = self->state;
+    for (uint i = 0, n; i < nblocks; i += n) {
+        n = nblocks - i;
+        if (n > RESERVE_NBLOCKS) n = RESERVE_NBLOCKS;
+
+        struct treedisk_snapshot snapshot;
+        if (treedisk_begin(ts) < 0) return -1;
+        if (treedisk_get_snapshot(&snapshot, ts, ino) < 0) return -1;
+        block_no size      = snapshot.inode->nblocks;
+        block_no first_new = (offset + i > size) ? offset + i : size;
+        ts->reserve_next   = 0;
+        ts->reserve_end    = (offset + i + n > first_new)
+                                 ? offset + i + n - first_new
+                                 : 0;
+        treedisk_alloc_blocks(ts, &snapshot, ts->reserve_end, ts->reserved);
+
+        for (uint j = i; j < i + n; j++)
+            if (treedisk_write_one(self, ino, offset + j, &blocks[j],
+                                   offset + nblocks == 1) < 0) {
+                ts->reserve_end = 0;
+                return -1;
+            }
+
+        /* Return the reserved blocks not used, e.g., for an inline file.
+         */
+        while (snapshot.superblock.superblock.version == TREEDISK_BITMAP &&
+               ts->reserve_next < ts->reserve_end)
+            treedisk_bitmap_set(ts, ts->reserved[ts->reserve_next++], 0);
+        ts->reserve_end = 0;
+        if (treedisk_sync_bitmap(ts) < 0) return -1;
+    }
+    return 0;
+}
+
+/* Commit the logged blocks and sync the inode store below.
+ */
+static int treedisk_sync(inode_intf self) {
+    struct treedisk_state* ts = self->state;
+    if (ts->log_n > 0) return treedisk_commit(ts);
+    return ts->below->sync ? (*ts->below->sync)(ts->below) : 0;
+}
+
 /* Open a virtual inode store on the specified inode of the inode store below.
  */
 
@@ -366,6 +883,9 @@ inode_intf treedisk_init(inode_intf below, uint below_ino) {
     self->setsize = treedisk_setsize;
     self->read    = treedisk_read;
     self->write   = treedisk_write;
+    self->readv   = treedisk_readv;
+    self->writev  = treedisk_writev;
+    self->sync    = treedisk_sync;
     return self;
 }
 
@@ -375,7 +895,11 @@ inode_intf treedisk_init(inode_intf below, uint below_ino) {
  ************************************************************************/
 
 /* Create the free list and return the block number of the first
- * block on it.
+ * block on it.  The free list is built from the last chunk of
+ * REFS_PER_BLOCK blocks backwards, so that treedisk_alloc_block() hands
+ * out the blocks in ascending order: within a chunk, the references are
+ * taken from the highest slot down to slot 1, and the freelist block
+ * itself, the last block of the chunk, is taken after them.
  */
 block_no setup_freelist(inode_intf below, uint below_ino, block_no next_free,
                         block_no nblocks) {
@@ -383,11 +907,14 @@ block_no setup_freelist(inode_intf below, uint below_ino, block_no next_free,
     block_no freelist_block = 0;
     uint i;
 
-    while (next_free < nblocks) {
+    if (next_free >= nblocks) return 0;
+    block_no start = next_free + (nblocks - next_free - 1) / REFS_PER_BLOCK *
+                                     REFS_PER_BLOCK;
+    for (block_no end = nblocks; end > next_free;
+         end = start, start -= REFS_PER_BLOCK) {
         freelist_data[0] = freelist_block;
-        freelist_block   = next_free++;
-        for (i = 1; i < REFS_PER_BLOCK && next_free < nblocks; i++)
-            freelist_data[i] = next_free++;
+        freelist_block   = end - 1;
+        for (i = 1; i < end - start; i++) freelist_data[i] = end - 1 - i;
 
         for (; i < REFS_PER_BLOCK; i++) freelist_data[i] = 0;
 
@@ -398,6 +925,26 @@ block_no setup_freelist(inode_intf below, uint below_ino, block_no next_free,
     return freelist_block;
 }
 
+/* Create the bitmap in the n_bitmapblocks blocks starting at 'start'.
+ * The superblock, the inode blocks, the bitmap blocks and the n_logblocks
+ * log blocks after them are in use.
+ */
+int setup_bitmap(inode_intf below, uint below_ino, block_no start,
+                 block_no n_bitmapblocks, block_no n_logblocks) {
+    block_no nused = start + n_bitmapblocks + n_logblocks;
+    for (block_no i = 0; i < n_bitmapblocks; i++) {
+        union treedisk_block block;
+        memset(&block, 0, BLOCK_SIZE);
+        for (block_no b = i * BITS_PER_BLOCK;
+             b < nused && b < (i + 1) * BITS_PER_BLOCK; b++)
+            block.bitmapblock.bits[b % BITS_PER_BLOCK / 32] |= 1U << (b % 32);
+
+        if ((*below->write)(below, below_ino, start + i, (block_t*)&block) < 0)
+            return -1;
+    }
+    return 0;
+}
+
 /* Create a new file system on the specified inode of the inode store below.
  */
 int treedisk_create(inode_intf below, uint below_ino, uint ninodes) {
@@ -405,14 +952,24 @@ int treedisk_create(inode_intf below, uint below_ino, uint ninodes) {
         panic("treedisk_create: block has wrong size");
     }
 
-    /* Compute the number of inode blocks needed to store the inodes.
+    /* Compute the number of inode blocks needed to store the inodes,
+     * and the number of bitmap blocks.  The bitmap format also keeps
+     * small files inline in the inode blocks and has a log.
      */
-    uint n_inodeblocks = (ninodes + INODES_PER_BLOCK - 1) / INODES_PER_BLOCK;
+    uint inline_data   = (TREEDISK_VERSION == TREEDISK_BITMAP);
+    uint per_block     = inline_data ? INLINE_INODES_PER_BLOCK
+                                     : INODES_PER_BLOCK;
+    uint n_inodeblocks = (ninodes + per_block - 1) / per_block;
 
     /* Get the size of the underlying disk and see if it's large enough.
      */
-    uint nblocks = (*below->getsize)(below, below_ino);
-    if (nblocks < n_inodeblocks + 2) {
+    uint nblocks        = (*below->getsize)(below, below_ino);
+    uint n_bitmapblocks = 0, n_logblocks = 0;
+    if (TREEDISK_VERSION == TREEDISK_BITMAP) {
+        n_bitmapblocks = (nblocks + BITS_PER_BLOCK - 1) / BITS_PER_BLOCK;
+        n_logblocks    = LOG_NBLOCKS;
+    }
+    if (nblocks < n_inodeblocks + n_bitmapblocks + n_logblocks + 2) {
         printf("treedisk_create: too few blocks\n");
         return -1;
     }
@@ -429,8 +986,25 @@ int treedisk_create(inode_intf below, uint below_ino, uint ninodes) {
         union treedisk_block superblock;
         memset(&superblock, 0, BLOCK_SIZE);
         superblock.superblock.n_inodeblocks = n_inodeblocks;
-        superblock.superblock.free_list =
-            setup_freelist(below, below_ino, n_inodeblocks + 1, nblocks);
+        superblock.superblock.version       = TREEDISK_VERSION;
+        superblock.superblock.inline_data   = inline_data;
+        if (TREEDISK_VERSION == TREEDISK_BITMAP) {
+            superblock.superblock.n_bitmapblocks = n_bitmapblocks;
+            superblock.superblock.nblocks        = nblocks;
+            superblock.superblock.n_logblocks    = n_logblocks;
+            if (setup_bitmap(below, below_ino, n_inodeblocks + 1,
+                             n_bitmapblocks, n_logblocks) < 0)
+                return -1;
+
+            /* The log starts out with an empty commit.
+             */
+            block_no log_start = n_inodeblocks + 1 + n_bitmapblocks;
+            if ((*below->write)(below, below_ino, log_start, &null_block) < 0)
+                return -1;
+        } else {
+            superblock.superblock.free_list =
+                setup_freelist(below, below_ino, n_inodeblocks + 1, nblocks);
+        }
         if ((*below->write)(below, below_ino, 0, (block_t*)&superblock) < 0)
             return -1;
 
@@ -443,8 +1017,10 @@ int treedisk_create(inode_intf below, uint below_ino, uint ninodes) {
 
         printf("treedisk: Created a new filesystem with %d inodes\n", ninodes);
     } else {
+        per_block = superblock.superblock.inline_data ? INLINE_INODES_PER_BLOCK
+                                                      : INODES_PER_BLOCK;
         printf("treedisk: a filesystem already exists with %lu inodes",
-               superblock.superblock.n_inodeblocks * INODES_PER_BLOCK);
+               superblock.superblock.n_inodeblocks * per_block);
     }
 
     return 0;
@@ -25,10 +25,37 @@
  * exist both for data and indirect blocks.  Reading from a hole returns
  * null bytes.
  *
- * The free list is a linked list of blocks.  Each block is filled with
- * block indices, the first of which is either 0 to indicate the end of
- * the list, or otherwise a pointer to the next block on the list.  The
- * remaining slots point to free blocks, or 0 if the slot is empty.
+ * The free space is kept in one of two formats, given by the version in
+ * the superblock.  In version 0 (TREEDISK_FREELIST), the free list is a
+ * linked list of blocks.  Each block is filled with block indices, the
+ * first of which is either 0 to indicate the end of the list, or otherwise
+ * a pointer to the next block on the list.  The remaining slots point to
+ * free blocks, or 0 if the slot is empty.
+ *
+ * In version 1 (TREEDISK_BITMAP), the inode blocks are followed by
+ * "bitmap blocks" with one bit for every block of the file system, which
+ * is set if the block is in use.  The bitmap is kept in memory, so a
+ * number of blocks can be allocated at once and the bitmap blocks are
+ * written back in bulk.
+ *
+ * If "inline_data" is set in the superblock (only with TREEDISK_BITMAP),
+ * an inode block holds INLINE_INODES_PER_BLOCK inodes and the bytes of
+ * their small files.  A file with one block is "inline" if its root is 0:
+ * the leading bytes of the block, up to the last non-null byte, are kept
+ * in the inode block, packed in the order of the inodes, and the rest of
+ * the block is null bytes.  A file which does not fit gets a data block
+ * as usual.
+ *
+ * If "n_logblocks" is set in the superblock (only with TREEDISK_BITMAP),
+ * the bitmap blocks are followed by a write-ahead log of LOG_NBLOCKS
+ * blocks.  The inode, bitmap and indirect blocks are not written in place
+ * but collected in memory, and the updates of many writes are committed
+ * together: the "log header", which lists the home locations of the
+ * blocks, and the blocks themselves are written to the log with one
+ * writev.  Only then are the blocks written to their home locations.  The
+ * log of the last commit is replayed when the file system is opened, so
+ * that a crash cannot leave the metadata half updated.  Data blocks are
+ * not logged, but they are written before the commit.
  */
 #pragma once
 #include "inode.h"
@@ -36,12 +63,28 @@
 typedef unsigned int block_no; /* index of a block */
 #define REFS_PER_BLOCK   (BLOCK_SIZE / sizeof(block_no))
 #define INODES_PER_BLOCK (BLOCK_SIZE / sizeof(struct treedisk_inode))
+#define BITS_PER_BLOCK   (BLOCK_SIZE * 8)
+
+#define INLINE_INODES_PER_BLOCK 4
+#define INLINE_BYTES_PER_BLOCK                                                 \
+    (BLOCK_SIZE - INLINE_INODES_PER_BLOCK * (sizeof(struct treedisk_inode) +   \
+                                             sizeof(block_no)))
+
+#define LOG_NBLOCKS 64 /* a log header and up to LOG_NBLOCKS - 1 blocks */
+
+#define TREEDISK_FREELIST 0
+#define TREEDISK_BITMAP   1
 
 /* Contents of the "superblock".  There is only one of these.
  */
 struct treedisk_superblock {
-    block_no n_inodeblocks; /* # blocks with inodes */
-    block_no free_list;     /* pointer to first block on free list */
+    block_no n_inodeblocks;  /* # blocks with inodes */
+    block_no free_list;      /* pointer to first block on free list */
+    block_no version;        /* TREEDISK_FREELIST or TREEDISK_BITMAP */
+    block_no n_bitmapblocks; /* # blocks with the bitmap (version 1) */
+    block_no nblocks;        /* # blocks in the file system (version 1) */
+    block_no inline_data;    /* whether small files are in inode blocks */
+    block_no n_logblocks;    /* # blocks with the write-ahead log */
 };
 
 /* An inode describes a file (= virtual inode store).  "nblocks" contains
@@ -61,6 +104,15 @@ struct treedisk_inodeblock {
     struct treedisk_inode inodes[INODES_PER_BLOCK];
 };
 
+/* An inode block of a file system with inline data.  inline_len[i] is the
+ * number of bytes of inodes[i] in data[].
+ */
+struct treedisk_inlineblock {
+    struct treedisk_inode inodes[INLINE_INODES_PER_BLOCK];
+    block_no inline_len[INLINE_INODES_PER_BLOCK];
+    char data[INLINE_BYTES_PER_BLOCK];
+};
+
 /* A freelist block is filled with references to other blocks, the first
  * one of which is the next freelist block (0 = end-of-list). Remember that
  * the freelist acts as a stack (freelist blocks are added FILO).
@@ -69,6 +121,22 @@ struct treedisk_freelistblock {
     block_no refs[REFS_PER_BLOCK];
 };
 
+/* A bitmap block has one bit for each of BITS_PER_BLOCK blocks; Block b
+ * is in use if bit b % 32 of bits[b / 32] is set in the whole bitmap.
+ */
+struct treedisk_bitmapblock {
+    block_no bits[REFS_PER_BLOCK];
+};
+
+/* The first block of the log describes the last commit.  The checksum
+ * covers home[] and the logged blocks, so a torn commit is ignored.
+ */
+struct treedisk_logheader {
+    block_no nblocks;  /* # blocks in the last commit */
+    block_no checksum; /* see treedisk_log_checksum() */
+    block_no home[LOG_NBLOCKS - 1];
+};
+
 /* An indirect block is an internal node in the tree rooted at an inode.
  */
 struct treedisk_indirblock {
@@ -82,6 +150,9 @@ union treedisk_block {
     block_t datablock;
     struct treedisk_superblock superblock;
     struct treedisk_inodeblock inodeblock;
+    struct treedisk_inlineblock inlineblock;
     struct treedisk_freelistblock freelistblock;
+    struct treedisk_bitmapblock bitmapblock;
+    struct treedisk_logheader logheader;
     struct treedisk_indirblock indirblock;
 };
@@ -26,6 +26,19 @@
  * int write(inode_intf self, unsigned int ino, uint offset, block_t *block)
  *   - writes *block to the block at the given inode number and offset
  *
+ * int readv(inode_intf self, unsigned int ino, uint offset, uint nblocks,
+ *           block_t *blocks)
+ *   - reads nblocks blocks starting at the given offset into blocks[]
+ *
+ * int writev(inode_intf self, unsigned int ino, uint offset, uint nblocks,
+ *            block_t *blocks)
+ *   - writes blocks[] to nblocks blocks starting at the given offset
+ *
+ * int sync(inode_intf self)
+ *   - writes the blocks buffered in this inode store to the inode store
+ *     below, and then calls sync() of the inode store below if any
+ *     (sync is NULL for an inode store without buffered blocks)
+ *
  * All these return -1 upon error (typically after printing the eason for
  * the error) and return 0 upon success.
  *
@@ -44,9 +57,26 @@ struct inode_store {
     int (*setsize)(inode_intf self, uint ino, uint newsize);
     int (*read)(inode_intf self, uint ino, uint offset, block_t* block);
     int (*write)(inode_intf self, uint ino, uint offset, block_t* block);
+    int (*readv)(inode_intf self, uint ino, uint offset, uint nblocks,
+                 block_t* blocks);
+    int (*writev)(inode_intf self, uint ino, uint offset, uint nblocks,
+                  block_t* blocks);
+    int (*sync)(inode_intf self);
     void* state;
 };
 
+/* A cache layer between a file system and the disk (see cache.c). */
+struct cache_stats {
+    uint nblocks;        /* cache size in blocks                  */
+    uint nhits, nmisses; /* reads served by the cache or the disk */
+    uint nevicts;        /* blocks evicted to make room           */
+    uint nwrites;        /* blocks written to the cache           */
+    uint nwritebacks;    /* blocks written to the disk            */
+};
+inode_intf cachedisk_init(inode_intf below, uint nblocks, uint write_through);
+int cachedisk_sync(inode_intf self);
+void cachedisk_get_stats(inode_intf self, struct cache_stats* stats);
+
 /* There are 2 file systems in egos-2000 right now: mydisk and treedisk. */
 inode_intf mydisk_init(inode_intf below, uint below_ino);
 int mydisk_create(inode_intf below, uint below_ino, uint ninodes);
@@ -0,0 +1,55 @@
+/*
+ * (C) 2025, Cornell University
+ * All rights reserved.
+ *
+ * Description: the job queue of the worker in GPID_FILE
+ * job_push() and job_pop() keep the jobs in a FIFO queue, and
+ * job_serve_now() decides whether GPID_FILE may serve a request itself
+ * while the worker runs a job.
+ */
+
+#ifdef MKFS
+#include <sys/types.h>
+#else
+#include "egos.h"
+#endif
+
+#include "job.h"
+#include <stddef.h>
+
+void job_push(struct job_queue* q, int sender, struct file_request* req) {
+    struct job* job = &q->jobs[(q->head + q->cnt++) % JOB_QUEUE_SIZE];
+    job->sender     = sender;
+    job->req        = *req;
+}
+
+int job_pop(struct job_queue* q, struct job* job) {
+    if (q->cnt == 0) return -1;
+    *job    = q->jobs[q->head];
+    q->head = (q->head + 1) % JOB_QUEUE_SIZE;
+    q->cnt--;
+    return 0;
+}
+
+/* Whether GPID_FILE may try to serve req right away while the worker runs
+ * job 'running' (NULL if the worker is idle); The worker may wait for the
+ * disk in the middle of its job, and GPID_FILE then serves the requests
+ * hitting the cache:
+ * - A read which misses the cache fails before it changes the cache or
+ *   treedisk, since only the worker can wait for the disk; With RAMDISK,
+ *   the worker only waits while it syncs the pages of the RAM disk.
+ * - The block cache, the inode blocks cached by treedisk and the blocks in
+ *   the log of treedisk are changed block by block between waits, so they
+ *   always hold whole blocks, and a block being written back stays cached
+ *   until the write is done.
+ * - The inode being written by the worker may have its indirect blocks and
+ *   its size half updated, so the requests reading it wait for the worker,
+ *   and so do the paths, which may go through it if it is a directory.
+ * The requests which write or map pages are always left to the worker. */
+int job_serve_now(struct file_request* req, struct job* running) {
+    if (req->type == FILE_WRITE || req->type == FILE_SYNC ||
+        req->type == FILE_MMAP)
+        return 0;
+    if (running == NULL || running->req.type != FILE_WRITE) return 1;
+    return req->type != FILE_LOOKUP_PATH && req->ino != running->req.ino;
+}
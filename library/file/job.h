@@ -0,0 +1,23 @@
+#pragma once
+
+/* GPID_FILE serves a request right away if the blocks it needs are cached.
+ * Otherwise, the request becomes a job for the worker, which waits for the
+ * disk without blocking GPID_FILE (see apps/system/sys_file.c). The jobs
+ * wait in a FIFO queue of JOB_QUEUE_SIZE jobs. */
+#include "servers.h"
+
+#define JOB_QUEUE_SIZE 8
+
+struct job {
+    int sender; /* GPID_UNUSED for a job queued by GPID_FILE itself */
+    struct file_request req;
+};
+
+struct job_queue {
+    struct job jobs[JOB_QUEUE_SIZE];
+    uint head, cnt;
+};
+
+void job_push(struct job_queue* q, int sender, struct file_request* req);
+int job_pop(struct job_queue* q, struct job* job);
+int job_serve_now(struct file_request* req, struct job* running);
@@ -2,27 +2,185 @@
  * (C) 2025, Cornell University
  * All rights reserved.
  *
- * Description: system support for C library function malloc()
+ * Description: a slab allocator for malloc() and free()
+ * The heap is cut into 4KB slabs. A slab holds objects of one size class
+ * (16, 32, ..., 2048 bytes), and a free object goes back to the free list of
+ * its size class, so malloc() and free() take O(1) time for small objects.
+ * An allocation larger than 2048 bytes takes a run of consecutive slabs.
+ * malloc() returns NULL when the heap is full, and the reentrant versions
+ * used inside newlib (e.g., for stdio buffers) go to the same allocator.
  */
 
 #include "egos.h"
+#include <stdlib.h>
+#include <string.h>
 
 /* Heap start and end are defined in library/elf/{egos/app}.lds. */
 extern char __heap_start, __heap_end;
 static char* brk = &__heap_start;
 
-/* malloc() and free() are linked from the compiler's C library;
- * malloc() and free() manage the memory region [&__heap_start, brk).
- * If malloc() finds it too small, malloc() will call _sbrk() to increase brk.
+/* The slab allocator below manages the memory region [&__heap_start, brk).
+ * If there is no free slab, the allocator calls _sbrk() to increase brk,
+ * which returns (char*)-1 if the heap would grow past __heap_end.
  */
 
 char* _sbrk(int size) {
-    if (brk + size > (char*)&__heap_end) {
-        printf("_sbrk: heap grows too large\n\r");
-        *(int*)(0) = 1; /* Trigger a memory exception. */
-    }
+    if (brk + size > (char*)&__heap_end) return (char*)-1;
 
     char* old_brk = brk;
     brk += size;
     return old_brk;
 }
+
+#define SLAB_SIZE     4096
+#define MAX_NSLABS    512 /* the heap is smaller than 2MB */
+#define NCLASSES      8
+#define LARGE         NCLASSES
+#define CLASS_SIZE(x) (16 << (x))
+#define SLAB_NO(ptr)  (((char*)(ptr) - slab_base) / SLAB_SIZE)
+#define RUN_END(run)  ((char*)(run) + (run)->nslabs * SLAB_SIZE)
+
+struct free_obj {
+    struct free_obj* next;
+};
+
+struct free_run {
+    struct free_run* next;
+    uint nslabs;
+};
+
+static char* slab_base;
+static struct free_obj* free_objs[NCLASSES];
+static struct free_run* free_runs;
+static struct heap_stats stats;
+static struct slab_info {
+    uchar class;   /* 0 .. NCLASSES - 1, or LARGE */
+    ushort nslabs; /* number of slabs for a LARGE allocation */
+} slab_info[MAX_NSLABS];
+
+static char* slab_alloc(uint nslabs) {
+    /* Reuse freed slabs (first fit) before growing the heap. */
+    for (struct free_run** prev = &free_runs; *prev; prev = &(*prev)->next) {
+        struct free_run* run = *prev;
+        if (run->nslabs < nslabs) continue;
+        if (run->nslabs == nslabs) {
+            *prev = run->next;
+            return (char*)run;
+        }
+        run->nslabs -= nslabs;
+        return (char*)run + run->nslabs * SLAB_SIZE;
+    }
+
+    /* Align the first slab to SLAB_SIZE. */
+    if (slab_base == NULL) {
+        if (_sbrk(-(uint)brk % SLAB_SIZE) == (char*)-1) return NULL;
+        slab_base = brk;
+    }
+
+    char* slab = _sbrk(nslabs * SLAB_SIZE);
+    if (slab == (char*)-1) return NULL;
+    stats.size += nslabs * SLAB_SIZE;
+    return slab;
+}
+
+void* malloc(size_t size) {
+    if (size > MAX_NSLABS * SLAB_SIZE) return NULL;
+
+    uint class = 0;
+    while (class < NCLASSES && CLASS_SIZE(class) < size) class++;
+
+    char* ptr;
+    if (class == LARGE) {
+        uint nslabs = (size + SLAB_SIZE - 1) / SLAB_SIZE;
+        if ((ptr = slab_alloc(nslabs)) == NULL) return NULL;
+        slab_info[SLAB_NO(ptr)].class  = LARGE;
+        slab_info[SLAB_NO(ptr)].nslabs = nslabs;
+        stats.in_use += nslabs * SLAB_SIZE;
+    } else {
+        if (free_objs[class] == NULL) {
+            /* Cut a new slab into objects of this size class. */
+            char* slab = slab_alloc(1);
+            if (slab == NULL) return NULL;
+            slab_info[SLAB_NO(slab)].class = class;
+            for (uint off = SLAB_SIZE; off > 0;) {
+                off -= CLASS_SIZE(class);
+                struct free_obj* obj = (void*)(slab + off);
+                obj->next            = free_objs[class];
+                free_objs[class]     = obj;
+            }
+        }
+        ptr              = (char*)free_objs[class];
+        free_objs[class] = free_objs[class]->next;
+        stats.in_use += CLASS_SIZE(class);
+    }
+
+    stats.nmalloc++;
+    return ptr;
+}
+
+static uint malloc_size(void* ptr) {
+    struct slab_info* info = &slab_info[SLAB_NO(ptr)];
+    return (info->class == LARGE) ? info->nslabs * SLAB_SIZE
+                                  : CLASS_SIZE(info->class);
+}
+
+void free(void* ptr) {
+    if (ptr == NULL) return;
+
+    stats.nfree++;
+    stats.in_use -= malloc_size(ptr);
+    struct slab_info* info = &slab_info[SLAB_NO(ptr)];
+    if (info->class == LARGE) {
+        /* Keep free_runs sorted by address and merge the adjacent runs. */
+        struct free_run *run = ptr, *left = NULL, **prev = &free_runs;
+        for (; *prev && (char*)*prev < (char*)run; prev = &(*prev)->next)
+            left = *prev;
+        run->nslabs = info->nslabs;
+        run->next   = *prev;
+        *prev       = run;
+
+        if (run->next && RUN_END(run) == (char*)run->next) {
+            run->nslabs += run->next->nslabs;
+            run->next = run->next->next;
+        }
+        if (left && RUN_END(left) == (char*)run) {
+            left->nslabs += run->nslabs;
+            left->next = run->next;
+        }
+    } else {
+        struct free_obj* obj   = ptr;
+        obj->next              = free_objs[info->class];
+        free_objs[info->class] = obj;
+    }
+}
+
+void* calloc(size_t nmemb, size_t size) {
+    if (size && nmemb > (size_t)-1 / size) return NULL;
+
+    void* ptr = malloc(nmemb * size);
+    if (ptr) memset(ptr, 0, nmemb * size);
+    return ptr;
+}
+
+void* realloc(void* ptr, size_t size) {
+    if (ptr == NULL) return malloc(size);
+    if (size <= malloc_size(ptr)) return ptr;
+
+    void* new_ptr = malloc(size);
+    if (new_ptr == NULL) return NULL;
+    memcpy(new_ptr, ptr, malloc_size(ptr));
+    free(ptr);
+    return new_ptr;
+}
+
+struct _reent;
+void* _malloc_r(struct _reent* r, size_t size) { return malloc(size); }
+void _free_r(struct _reent* r, void* ptr) { free(ptr); }
+void* _calloc_r(struct _reent* r, size_t nmemb, size_t size) {
+    return calloc(nmemb, size);
+}
+void* _realloc_r(struct _reent* r, void* ptr, size_t size) {
+    return realloc(ptr, size);
+}
+
+void heap_get_stats(struct heap_stats* ret) { *ret = stats; }
@@ -0,0 +1,198 @@
+/*
+ * (C) 2025, Cornell University
+ * All rights reserved.
+ *
+ * Description: memcpy() and memset() for RV32
+ * These replace the C library versions for the kernel and the apps. Aligned
+ * buffers are handled 32 bytes (8 words) per iteration and a 4KB page is
+ * handled 64 bytes per iteration; See apps/user/membench.c for the numbers.
+ */
+    .section .text.memcpy
+    .global memcpy
+memcpy:
+    /* a0: dst, a1: src, a2: n; a7 walks through dst and a0 is returned. */
+    mv a7, a0
+    xor t0, a0, a1
+    andi t0, t0, 3
+    bnez t0, .Lcpy_byte      /* dst and src can never be both aligned */
+
+    li t0, 4096
+    bne a2, t0, .Lcpy_head
+    andi t0, a0, 3
+    beqz t0, .Lcpy_page
+
+.Lcpy_head:                  /* copy bytes until dst is aligned */
+    andi t0, a7, 3
+    beqz t0, .Lcpy_word8
+    beqz a2, .Lcpy_done
+    lbu t0, 0(a1)
+    sb t0, 0(a7)
+    addi a1, a1, 1
+    addi a7, a7, 1
+    addi a2, a2, -1
+    j .Lcpy_head
+
+.Lcpy_word8:                 /* copy 8 words per iteration */
+    li t0, 32
+    bltu a2, t0, .Lcpy_word
+    lw t0, 0(a1)
+    lw t1, 4(a1)
+    lw t2, 8(a1)
+    lw t3, 12(a1)
+    lw t4, 16(a1)
+    lw t5, 20(a1)
+    lw t6, 24(a1)
+    lw a3, 28(a1)
+    sw t0, 0(a7)
+    sw t1, 4(a7)
+    sw t2, 8(a7)
+    sw t3, 12(a7)
+    sw t4, 16(a7)
+    sw t5, 20(a7)
+    sw t6, 24(a7)
+    sw a3, 28(a7)
+    addi a1, a1, 32
+    addi a7, a7, 32
+    addi a2, a2, -32
+    j .Lcpy_word8
+
+.Lcpy_word:                  /* copy the remaining words */
+    li t0, 4
+    bltu a2, t0, .Lcpy_byte
+    lw t0, 0(a1)
+    sw t0, 0(a7)
+    addi a1, a1, 4
+    addi a7, a7, 4
+    addi a2, a2, -4
+    j .Lcpy_word
+
+.Lcpy_byte:                  /* copy the remaining bytes */
+    beqz a2, .Lcpy_done
+    lbu t0, 0(a1)
+    sb t0, 0(a7)
+    addi a1, a1, 1
+    addi a7, a7, 1
+    addi a2, a2, -1
+    j .Lcpy_byte
+
+.Lcpy_page:                  /* copy an aligned 4KB page, 16 words a time */
+    add a2, a1, a2           /* a2 is the end of src */
+1:
+    lw t0, 0(a1)
+    lw t1, 4(a1)
+    lw t2, 8(a1)
+    lw t3, 12(a1)
+    lw t4, 16(a1)
+    lw t5, 20(a1)
+    lw t6, 24(a1)
+    lw a3, 28(a1)
+    sw t0, 0(a7)
+    sw t1, 4(a7)
+    sw t2, 8(a7)
+    sw t3, 12(a7)
+    sw t4, 16(a7)
+    sw t5, 20(a7)
+    sw t6, 24(a7)
+    sw a3, 28(a7)
+    lw t0, 32(a1)
+    lw t1, 36(a1)
+    lw t2, 40(a1)
+    lw t3, 44(a1)
+    lw t4, 48(a1)
+    lw t5, 52(a1)
+    lw t6, 56(a1)
+    lw a3, 60(a1)
+    sw t0, 32(a7)
+    sw t1, 36(a7)
+    sw t2, 40(a7)
+    sw t3, 44(a7)
+    sw t4, 48(a7)
+    sw t5, 52(a7)
+    sw t6, 56(a7)
+    sw a3, 60(a7)
+    addi a1, a1, 64
+    addi a7, a7, 64
+    bne a1, a2, 1b
+
+.Lcpy_done:
+    ret
+
+    .section .text.memset
+    .global memset
+memset:
+    /* a0: dst, a1: byte, a2: n; a7 walks through dst and a0 is returned. */
+    mv a7, a0
+    andi a1, a1, 0xFF
+    slli t0, a1, 8
+    or a1, a1, t0
+    slli t0, a1, 16
+    or a1, a1, t0            /* a1 holds 4 copies of the byte */
+
+    li t0, 4096
+    bne a2, t0, .Lset_head
+    andi t0, a0, 3
+    beqz t0, .Lset_page
+
+.Lset_head:                  /* set bytes until dst is aligned */
+    andi t0, a7, 3
+    beqz t0, .Lset_word8
+    beqz a2, .Lset_done
+    sb a1, 0(a7)
+    addi a7, a7, 1
+    addi a2, a2, -1
+    j .Lset_head
+
+.Lset_word8:                 /* set 8 words per iteration */
+    li t0, 32
+    bltu a2, t0, .Lset_word
+    sw a1, 0(a7)
+    sw a1, 4(a7)
+    sw a1, 8(a7)
+    sw a1, 12(a7)
+    sw a1, 16(a7)
+    sw a1, 20(a7)
+    sw a1, 24(a7)
+    sw a1, 28(a7)
+    addi a7, a7, 32
+    addi a2, a2, -32
+    j .Lset_word8
+
+.Lset_word:                  /* set the remaining words */
+    li t0, 4
+    bltu a2, t0, .Lset_byte
+    sw a1, 0(a7)
+    addi a7, a7, 4
+    addi a2, a2, -4
+    j .Lset_word
+
+.Lset_byte:                  /* set the remaining bytes */
+    beqz a2, .Lset_done
+    sb a1, 0(a7)
+    addi a7, a7, 1
+    addi a2, a2, -1
+    j .Lset_byte
+
+.Lset_page:                  /* set an aligned 4KB page, 16 words a time */
+    add a2, a7, a2           /* a2 is the end of dst */
+1:
+    sw a1, 0(a7)
+    sw a1, 4(a7)
+    sw a1, 8(a7)
+    sw a1, 12(a7)
+    sw a1, 16(a7)
+    sw a1, 20(a7)
+    sw a1, 24(a7)
+    sw a1, 28(a7)
+    sw a1, 32(a7)
+    sw a1, 36(a7)
+    sw a1, 40(a7)
+    sw a1, 44(a7)
+    sw a1, 48(a7)
+    sw a1, 52(a7)
+    sw a1, 56(a7)
+    sw a1, 60(a7)
+    addi a7, a7, 64
+    bne a7, a2, 1b
+
+.Lset_done:
+    ret
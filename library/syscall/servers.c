@@ -11,6 +11,8 @@
 #include <stdlib.h>
 #include <string.h>
 
+#define PAGE_SIZE 4096
+
 static int sender;
 static char buf[SYSCALL_MSG_LEN];
 
@@ -32,16 +34,37 @@ void sleep(uint usec) {
 }
 
 int dir_lookup(int dir_ino, char* name) {
-    char buf[BLOCK_SIZE];
-    file_read(dir_ino, 0, buf);
+    /* GPID_FILE looks up the name in its cache or the directory blocks;
+     * Read library/file/dir.h to understand directory management. */
+    if (strlen(name) >= DIR_NAME_LEN) return -1;
+
+    struct file_request req;
+    req.type = FILE_LOOKUP;
+    req.ino  = dir_ino;
+    strcpy(req.path, name);
+
+    sys_send(GPID_FILE, (void*)&req, sizeof(req));
+    sys_recv(GPID_FILE, &sender, buf, SYSCALL_MSG_LEN);
+
+    struct file_reply* reply = (void*)buf;
+    return reply->status == FILE_OK ? reply->ino : -1;
+}
 
-    /* Read tools/mkfs.c to understand directory management. */
-    for (uint i = 0, namelen = strlen(name); i < strlen(buf) - namelen; i++)
-        if (!strncmp(name, buf + i, namelen) && buf[i + namelen] == ' ' &&
-            (i == 0 || buf[i - 1] == ' '))
-            return atoi(buf + i + namelen);
+int path_lookup(int dir_ino, char* path) {
+    /* GPID_FILE resolves the whole path, e.g., "/home/yunhao/README" from
+     * the root directory or "../rvr" from directory dir_ino. */
+    if (strlen(path) >= FILE_PATH_LEN) return -1;
 
-    return -1;
+    struct file_request req;
+    req.type = FILE_LOOKUP_PATH;
+    req.ino  = dir_ino;
+    strcpy(req.path, path);
+
+    sys_send(GPID_FILE, (void*)&req, sizeof(req));
+    sys_recv(GPID_FILE, &sender, buf, SYSCALL_MSG_LEN);
+
+    struct file_reply* reply = (void*)buf;
+    return reply->status == FILE_OK ? reply->ino : -1;
 }
 
 int file_read(int file_ino, uint offset, char* block) {
@@ -54,7 +77,115 @@ int file_read(int file_ino, uint offset, char* block) {
     sys_recv(GPID_FILE, &sender, buf, SYSCALL_MSG_LEN);
 
     struct file_reply* reply = (void*)buf;
-    memcpy(block, reply->block.bytes, BLOCK_SIZE);
+    memcpy(block, reply->blocks[0].bytes, BLOCK_SIZE);
+
+    return reply->status == FILE_OK ? 0 : -1;
+}
+
+int file_readv(int file_ino, uint offset, uint nblocks, char* blocks) {
+    /* Read up to FILE_READ_NBLOCKS blocks with one request and one reply;
+     * Return the number of blocks read, which is fewer than nblocks if
+     * nblocks is larger than FILE_READ_NBLOCKS or the file ends early. */
+    struct file_request req;
+    req.type    = FILE_READV;
+    req.ino     = file_ino;
+    req.offset  = offset;
+    req.nblocks = nblocks;
+
+    sys_send(GPID_FILE, (void*)&req, sizeof(req));
+    sys_recv(GPID_FILE, &sender, buf, SYSCALL_MSG_LEN);
+
+    struct file_reply* reply = (void*)buf;
+    if (reply->status != FILE_OK) return -1;
+    memcpy(blocks, reply->blocks, reply->nblocks * BLOCK_SIZE);
+    return reply->nblocks;
+}
+
+int file_stream(int file_ino, uint offset, uint nblocks, char* blocks) {
+    /* Read nblocks blocks with one request; GPID_FILE sends one reply for
+     * every FILE_READ_NBLOCKS blocks until the range or the file ends. */
+    if (nblocks == 0) return 0;
+
+    struct file_request req;
+    req.type    = FILE_STREAM;
+    req.ino     = file_ino;
+    req.offset  = offset;
+    req.nblocks = nblocks;
+    sys_send(GPID_FILE, (void*)&req, sizeof(req));
+
+    struct file_reply* reply = (void*)buf;
+    uint total               = 0;
+    int status               = FILE_OK;
+    while (total < nblocks) {
+        sys_recv(GPID_FILE, &sender, buf, SYSCALL_MSG_LEN);
+        if ((status = reply->status) != FILE_OK) break;
+        memcpy(blocks + total * BLOCK_SIZE, reply->blocks,
+               reply->nblocks * BLOCK_SIZE);
+        total += reply->nblocks;
+        if (reply->nblocks < FILE_READ_NBLOCKS) break;
+    }
+    return status == FILE_OK ? total : -1;
+}
+
+int file_write(int file_ino, uint offset, char* block) {
+    struct file_request req;
+    req.type   = FILE_WRITE;
+    req.ino    = file_ino;
+    req.offset = offset;
+    memcpy(req.block.bytes, block, BLOCK_SIZE);
+
+    sys_send(GPID_FILE, (void*)&req, sizeof(req));
+    sys_recv(GPID_FILE, &sender, buf, SYSCALL_MSG_LEN);
+
+    struct file_reply* reply = (void*)buf;
+    return reply->status == FILE_OK ? 0 : -1;
+}
+
+int file_sync() {
+    /* Write the blocks cached by GPID_FILE back to the disk. */
+    struct file_request req;
+    req.type = FILE_SYNC;
+
+    sys_send(GPID_FILE, (void*)&req, sizeof(req));
+    sys_recv(GPID_FILE, &sender, buf, SYSCALL_MSG_LEN);
+
+    struct file_reply* reply = (void*)buf;
+    return reply->status == FILE_OK ? 0 : -1;
+}
+
+void* file_mmap(int file_ino, uint offset, uint nblocks) {
+    /* The mapping is private to the caller and lasts until the caller exits;
+     * Writing to the mapped memory does not modify the file. */
+    static uint mmap_brk = APPS_MMAP_BASE;
+    uint size = (nblocks * BLOCK_SIZE + PAGE_SIZE - 1) / PAGE_SIZE * PAGE_SIZE;
+    if (nblocks == 0 || mmap_brk + size > APPS_MMAP_END) return NULL;
+
+    struct file_request req;
+    req.type    = FILE_MMAP;
+    req.ino     = file_ino;
+    req.offset  = offset;
+    req.nblocks = nblocks;
+    req.vaddr   = mmap_brk;
+
+    sys_send(GPID_FILE, (void*)&req, sizeof(req));
+    sys_recv(GPID_FILE, &sender, buf, SYSCALL_MSG_LEN);
+
+    struct file_reply* reply = (void*)buf;
+    if (reply->status != FILE_OK) return NULL;
+
+    mmap_brk += size;
+    return (void*)req.vaddr;
+}
+
+int file_stats(struct cache_stats* stats) {
+    struct file_request req;
+    req.type = FILE_STATS;
+
+    sys_send(GPID_FILE, (void*)&req, sizeof(req));
+    sys_recv(GPID_FILE, &sender, buf, SYSCALL_MSG_LEN);
+
+    struct file_reply* reply = (void*)buf;
+    memcpy(stats, &reply->stats, sizeof(*stats));
 
     return reply->status == FILE_OK ? 0 : -1;
 }
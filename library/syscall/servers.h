@@ -5,7 +5,13 @@ void sleep(uint usec);
 int term_read(char* buf, uint len);
 void term_write(char* str, uint len);
 int dir_lookup(int dir_ino, char* name);
+int path_lookup(int dir_ino, char* path);
 int file_read(int file_ino, uint offset, char* block);
+int file_readv(int file_ino, uint offset, uint nblocks, char* blocks);
+int file_stream(int file_ino, uint offset, uint nblocks, char* blocks);
+int file_write(int file_ino, uint offset, char* block);
+int file_sync();
+void* file_mmap(int file_ino, uint offset, uint nblocks);
 
 enum grass_servers {
     GPID_ALL = -1,
@@ -49,19 +55,40 @@ struct term_reply {
 };
 
 /* GPID_FILE */
-#include "disk.h"
+#include "dir.h"
+#define FILE_PATH_LEN 128
 struct file_request {
     enum {
         FILE_UNUSED,
         FILE_READ,
         FILE_WRITE,
+        FILE_MMAP,
+        FILE_STATS,
+        FILE_SYNC,
+        FILE_READV,
+        FILE_STREAM,
+        FILE_LOOKUP,
+        FILE_LOOKUP_PATH,
     } type;
     uint ino;
     uint offset;
+    uint nblocks; /* FILE_MMAP: map nblocks blocks starting from offset */
+    uint vaddr;   /* FILE_MMAP: to the sender's address space at vaddr   */
     block_t block;
+    char path[FILE_PATH_LEN]; /* FILE_LOOKUP(_PATH): from directory ino */
 };
 
+/* FILE_READV replies with up to FILE_READ_NBLOCKS blocks of the range and
+ * FILE_STREAM replies with the whole range in several replies; A reply with
+ * fewer than FILE_READ_NBLOCKS blocks means the end of the file. */
+#define FILE_READ_NBLOCKS 4
+
 struct file_reply {
     enum file_status { FILE_OK, FILE_ERROR } status;
-    block_t block;
+    uint nblocks; /* FILE_READV and FILE_STREAM: number of blocks replied */
+    int ino;      /* FILE_LOOKUP: inode number of the name              */
+    block_t blocks[FILE_READ_NBLOCKS];
+    struct cache_stats stats; /* FILE_STATS */
 };
+
+int file_stats(struct cache_stats* stats);
@@ -14,6 +14,7 @@ static struct syscall* sc = (struct syscall*)SYSCALL_ARG;
 void sys_send(int receiver, char* msg, uint size) {
     sc->type     = SYS_SEND;
     sc->receiver = receiver;
+    sc->size     = size;
     memcpy(sc->content, msg, size);
     asm("ecall");
 }
@@ -22,6 +23,24 @@ void sys_recv(int from, int* sender, char* buf, uint size) {
     sc->type   = SYS_RECV;
     sc->sender = from;
     asm("ecall");
-    memcpy(buf, sc->content, size);
+    memcpy(buf, sc->content, size < sc->size ? size : sc->size);
     if (sender) *sender = sc->sender;
 }
+
+void sys_disk(struct disk_request* req) {
+    /* Block until the kernel has served the disk request. */
+    sc->type = SYS_DISK;
+    sc->size = sizeof(*req);
+    memcpy(sc->content, req, sizeof(*req));
+    asm("ecall");
+    memcpy(req, sc->content, sizeof(*req));
+}
+
+void sys_disk_submit(struct disk_request* req) {
+    /* Return once the kernel has queued the disk request; The caller then
+     * receives the served request as a message from GPID_UNUSED. */
+    sc->type = SYS_DISK_SUBMIT;
+    sc->size = sizeof(*req);
+    memcpy(sc->content, req, sizeof(*req));
+    asm("ecall");
+}
@@ -1,21 +1,28 @@
 #pragma once
 
 #include "servers.h"
+#include <stddef.h>
 
 enum syscall_type {
     SYS_UNUSED,
-    SYS_RECV, /* 1 */
-    SYS_SEND, /* 2 */
+    SYS_RECV,        /* 1 */
+    SYS_SEND,        /* 2 */
+    SYS_DISK,        /* 3 */
+    SYS_DISK_SUBMIT, /* 4 */
 };
 
-#define SYSCALL_MSG_LEN 1024
+#define SYSCALL_MSG_LEN 2560 /* enough for FILE_READ_NBLOCKS blocks */
 struct syscall {
-    enum syscall_type type; /* SYS_SEND or SYS_RECV */
+    enum syscall_type type; /* SYS_SEND, SYS_RECV or SYS_DISK(_SUBMIT) */
     int sender;             /* sender process ID    */
     int receiver;           /* receiver process ID  */
-    char content[SYSCALL_MSG_LEN];
     enum { PENDING, DONE } status;
+    uint size;              /* message bytes in content[] */
+    char content[SYSCALL_MSG_LEN];
 };
+#define SYSCALL_HEADER_LEN offsetof(struct syscall, content)
 
 void sys_send(int receiver, char* msg, uint size);
 void sys_recv(int from, int* sender, char* buf, uint size);
+void sys_disk(struct disk_request* req);
+void sys_disk_submit(struct disk_request* req);
@@ -0,0 +1,649 @@
+/*
+ * (C) 2025, Cornell University
+ * All rights reserved.
+ *
+ * Description: host tests for the file system layers in library/file
+ * The inode store modules run on top of a 2MB disk in memory which counts
+ * the operations reaching it, so the tests check both what is read back
+ * and how many disk operations it takes. Run with "make fstest"; A failed
+ * check stops the tests with FATAL().
+ */
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ucontext.h>
+#include "dir.h"
+#include "file1.h"
+#include "job.h"
+
+#define NBLOCKS    (FILE_SYS_DISK_SIZE / BLOCK_SIZE)
+#define CHECK(exp) ((exp) ? 0 : FATAL("%s:%d: %s", __FILE__, __LINE__, #exp))
+
+static block_t disk[NBLOCKS];
+static uint nops;        /* readv and writev operations reaching the disk */
+static uint fail_writes; /* make writev fail if set                        */
+
+int FATAL(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    printf("[FATAL] ");
+    vprintf(format, args);
+    printf("\n");
+    va_end(args);
+    exit(1);
+}
+
+static int disk_getsize(inode_intf bs, uint ino) { return NBLOCKS; }
+
+static int disk_setsize(inode_intf bs, uint ino, uint newsize) { return 0; }
+
+static int disk_readv(inode_intf bs, uint ino, uint offset, uint nblocks,
+                      block_t* blocks) {
+    CHECK(offset + nblocks <= NBLOCKS);
+    memcpy(blocks, &disk[offset], nblocks * BLOCK_SIZE);
+    nops++;
+    return 0;
+}
+
+static int disk_writev(inode_intf bs, uint ino, uint offset, uint nblocks,
+                       block_t* blocks) {
+    CHECK(offset + nblocks <= NBLOCKS);
+    if (fail_writes) return -1;
+    memcpy(&disk[offset], blocks, nblocks * BLOCK_SIZE);
+    nops++;
+    return 0;
+}
+
+static int disk_read(inode_intf bs, uint ino, uint offset, block_t* block) {
+    return disk_readv(bs, ino, offset, 1, block);
+}
+
+static int disk_write(inode_intf bs, uint ino, uint offset, block_t* block) {
+    return disk_writev(bs, ino, offset, 1, block);
+}
+
+static struct inode_store ramdisk = {.getsize = disk_getsize,
+                                     .setsize = disk_setsize,
+                                     .read    = disk_read,
+                                     .write   = disk_write,
+                                     .readv   = disk_readv,
+                                     .writev  = disk_writev};
+
+static inode_intf fs_create() {
+    memset(disk, 0, sizeof(disk));
+    CHECK(treedisk_create(&ramdisk, 0, NINODES) == 0);
+    return treedisk_init(&ramdisk, 0);
+}
+
+static inode_intf fs_reopen(inode_intf fs) {
+    /* Sync and read the file system again from the disk. */
+    CHECK(fs->sync(fs) == 0);
+    return treedisk_init(&ramdisk, 0);
+}
+
+static void fill(block_t* block, uint seed) {
+    for (uint i = 0; i < BLOCK_SIZE; i++) block->bytes[i] = seed * 31 + i;
+}
+
+#define NFILES      8
+#define FILE_BLOCKS 300
+static block_t files[NFILES][FILE_BLOCKS]; /* the expected contents */
+static uint sizes[NFILES];
+
+static void check_files(inode_intf fs) {
+    block_t block;
+    for (uint ino = 0; ino < NFILES; ino++) {
+        CHECK(fs->getsize(fs, ino) == sizes[ino]);
+        for (uint off = 0; off < sizes[ino]; off++) {
+            CHECK(fs->read(fs, ino, off, &block) == 0);
+            CHECK(memcmp(&block, &files[ino][off], BLOCK_SIZE) == 0);
+        }
+    }
+}
+
+static void test_random_writes() {
+    /* The superblock and the inode blocks cached by treedisk stay coherent
+     * with the disk under random writes; Reading a block of a two-level
+     * file takes the root block and the data block only. */
+    printf("random writes to %d files\n", NFILES);
+    inode_intf fs = fs_create();
+    memset(sizes, 0, sizeof(sizes));
+    srand(2000);
+    for (uint i = 0; i < 5000; i++) {
+        uint ino = rand() % NFILES, off = rand() % FILE_BLOCKS;
+        fill(&files[ino][off], rand());
+        CHECK(fs->write(fs, ino, off, &files[ino][off]) == 0);
+        if (off + 1 > sizes[ino]) sizes[ino] = off + 1;
+    }
+    check_files(fs);
+    check_files(fs_reopen(fs));
+
+    /* File NFILES has 100 blocks, so its root block points to data blocks. */
+    block_t block;
+    for (uint off = 0; off < 100; off++) {
+        fill(&block, off);
+        CHECK(fs->write(fs, NFILES, off, &block) == 0);
+    }
+    fs = fs_reopen(fs);
+    CHECK(fs->read(fs, NFILES, 0, &block) == 0);
+    nops = 0;
+    CHECK(fs->read(fs, NFILES, 5, &block) == 0);
+    CHECK(nops == 2);
+}
+
+static void test_inode_cache() {
+    /* All the inode blocks are cached, also with inline data: Reading the
+     * small files of all NINODES inodes again takes no disk operation. */
+    printf("inode block cache\n");
+    inode_intf fs = fs_create();
+    block_t block;
+    memset(&block, 0, BLOCK_SIZE);
+    for (uint ino = 0; ino < NINODES; ino++) {
+        block.bytes[0] = ino + 1;
+        CHECK(fs->write(fs, ino, 0, &block) == 0);
+    }
+    fs = fs_reopen(fs);
+    for (uint ino = 0; ino < NINODES; ino++)
+        CHECK(fs->read(fs, ino, 0, &block) == 0);
+
+    nops = 0;
+    for (uint ino = 0; ino < NINODES; ino++) {
+        CHECK(fs->read(fs, ino, 0, &block) == 0);
+        CHECK(block.bytes[0] == (char)(ino + 1));
+    }
+    CHECK(nops == 0);
+}
+
+static void test_sequential_file() {
+    /* A file written with one writev gets contiguous data blocks, so it is
+     * read back with a few readv operations instead of one per block. */
+    printf("sequential file of %d blocks\n", FILE_BLOCKS);
+    inode_intf fs = fs_create();
+    for (uint off = 0; off < FILE_BLOCKS; off++) fill(&files[0][off], off);
+    CHECK(fs->writev(fs, 0, 0, FILE_BLOCKS, files[0]) == 0);
+    fs = fs_reopen(fs);
+    CHECK(fs->getsize(fs, 0) == FILE_BLOCKS);
+
+    static block_t blocks[FILE_BLOCKS];
+    nops = 0;
+    CHECK(fs->readv(fs, 0, 0, FILE_BLOCKS, blocks) == 0);
+    CHECK(memcmp(blocks, files[0], sizeof(blocks)) == 0);
+    /* The file has 3 leaf indirect blocks, each read through the root
+     * block, and one run of data blocks for each leaf. */
+    CHECK(nops == 3 * 3);
+}
+
+static uint used_blocks() {
+    /* Count the blocks in use in the bitmap on the disk. */
+    struct treedisk_superblock* sb = &((union treedisk_block*)disk)->superblock;
+    CHECK(sb->version == TREEDISK_BITMAP);
+    uint nused = 0;
+    for (uint i = 0; i < sb->n_bitmapblocks; i++) {
+        union treedisk_block* b = (void*)&disk[1 + sb->n_inodeblocks + i];
+        for (uint j = 0; j < REFS_PER_BLOCK; j++)
+            nused += __builtin_popcount(b->bitmapblock.bits[j]);
+    }
+    return nused;
+}
+
+static void test_bitmap() {
+    /* Blocks are allocated and freed in the bitmap: A file switching
+     * between inline and a data block does not leak blocks, and growing a
+     * file uses its data blocks and indirect blocks only. */
+    printf("bitmap allocation\n");
+    inode_intf fs = fs_create();
+    CHECK(fs->sync(fs) == 0);
+    uint nused = used_blocks();
+
+    block_t big, small;
+    fill(&big, 1);
+    memset(&small, 0, BLOCK_SIZE);
+    small.bytes[0] = 1;
+    for (uint i = 0; i < 50; i++) {
+        CHECK(fs->write(fs, 3, 0, &big) == 0);
+        CHECK(fs->write(fs, 3, 0, &small) == 0);
+    }
+    CHECK(fs->sync(fs) == 0);
+    CHECK(used_blocks() == nused);
+
+    /* A 100-block file has a root indirect block and 100 data blocks. */
+    for (uint off = 0; off < 100; off++) fill(&files[0][off], off);
+    CHECK(fs->writev(fs, 4, 0, 100, files[0]) == 0);
+    fs = fs_reopen(fs);
+    CHECK(used_blocks() == nused + 101);
+
+    /* The reopened file system allocates from the bitmap on the disk. */
+    CHECK(fs->write(fs, 5, 1, &big) == 0);
+    CHECK(fs->sync(fs) == 0);
+    CHECK(used_blocks() == nused + 101 + 2);
+    block_t block;
+    for (uint off = 0; off < 100; off++) {
+        CHECK(fs->read(fs, 4, off, &block) == 0);
+        CHECK(memcmp(&block, &files[0][off], BLOCK_SIZE) == 0);
+    }
+}
+
+static void test_directory() {
+    /* A directory at most half full, as mkfs makes them, finds a name in
+     * about one block: Each read of a block costs the root block and the
+     * data block. */
+    printf("hashed directory\n");
+    inode_intf fs = fs_create();
+    uint nnames = 8 * DIR_ENTRIES_PER_BLOCK, nblocks = 16;
+    static struct dir_block blocks[16];
+    char name[DIR_NAME_LEN];
+    for (uint i = 0; i < nnames; i++) {
+        sprintf(name, (i % 4) ? "file%u" : "dir%u/", i);
+        CHECK(dir_insert(blocks, nblocks, name, 100 + i) == 0);
+    }
+    CHECK(fs->writev(fs, 1, 0, nblocks, (block_t*)blocks) == 0);
+    fs = fs_reopen(fs);
+    CHECK(dir_find(fs, 1, "nothing") == -1);
+
+    nops = 0;
+    for (uint i = 0; i < nnames; i++) {
+        sprintf(name, (i % 4) ? "file%u" : "dir%u/", i);
+        CHECK(dir_find(fs, 1, name) == 100 + i);
+    }
+    CHECK(nops / 2 <= nnames * 5 / 4);
+}
+
+static void make_dir(inode_intf fs, uint dir_ino, char* names[], uint n) {
+    /* Write directory dir_ino with names[i] -> inode names[i + 1]. */
+    static struct dir_block blocks[2];
+    memset(blocks, 0, sizeof(blocks));
+    for (uint i = 0; i < n; i += 2)
+        CHECK(dir_insert(blocks, 2, names[i], atoi(names[i + 1])) == 0);
+    CHECK(fs->writev(fs, dir_ino, 0, 2, (block_t*)blocks) == 0);
+}
+
+static void test_paths() {
+    /* Resolve paths with dir_find_path() as GPID_FILE does, in the tree
+     * / -> {bin/, home/ -> {yunhao/ -> {README}, ../}, README}. */
+    printf("path lookups\n");
+    inode_intf fs = fs_create();
+    char* root[]   = {"bin/", "2", "home/", "3", "README", "4", "../", "0"};
+    char* home[]   = {"yunhao/", "5", "../", "0"};
+    char* yunhao[] = {"README", "6", "../", "3"};
+    make_dir(fs, 0, root, 8);
+    make_dir(fs, 3, home, 4);
+    make_dir(fs, 5, yunhao, 4);
+    fs = fs_reopen(fs);
+
+    CHECK(dir_find_path(fs, 5, "/", dir_find) == 0);
+    CHECK(dir_find_path(fs, 5, "", dir_find) == 5);
+    CHECK(dir_find_path(fs, 5, "README", dir_find) == 6);
+    CHECK(dir_find_path(fs, 0, "README", dir_find) == 4);
+    CHECK(dir_find_path(fs, 0, "home", dir_find) == 3);
+    CHECK(dir_find_path(fs, 0, "home/", dir_find) == 3);
+    CHECK(dir_find_path(fs, 0, "home/yunhao/README", dir_find) == 6);
+    CHECK(dir_find_path(fs, 5, "/home/yunhao/README", dir_find) == 6);
+    CHECK(dir_find_path(fs, 5, "../../bin", dir_find) == 2);
+    CHECK(dir_find_path(fs, 5, "..//yunhao", dir_find) == 5);
+    CHECK(dir_find_path(fs, 0, "home/README", dir_find) == -1);
+    CHECK(dir_find_path(fs, 0, "README/home", dir_find) == -1);
+    CHECK(dir_find_path(fs, 0, "this_name_is_too_long_for_dirs", dir_find) ==
+          -1);
+}
+
+static void test_log() {
+    /* Metadata updates are collected in the log and committed together.
+     * A commit is replayed when the file system is opened again, unless the
+     * commit is torn. */
+    printf("write-ahead log\n");
+    inode_intf fs = fs_create();
+    for (uint off = 0; off < 100; off++) fill(&files[0][off], off);
+    CHECK(fs->writev(fs, 1, 0, 100, files[0]) == 0);
+    CHECK(fs->sync(fs) == 0);
+
+    /* Writing a block at a time, only the data blocks reach the disk. */
+    nops = 0;
+    for (uint off = 0; off < 99; off++)
+        CHECK(fs->write(fs, 2, off, &files[0][off]) == 0);
+    CHECK(nops == 99);
+    CHECK(fs->sync(fs) == 0);
+
+    /* Lose the home locations of the next commit, as in a crash right after
+     * the log is written. */
+    static block_t saved[NBLOCKS];
+    memcpy(saved, disk, sizeof(disk));
+    for (uint ino = 3; ino < 13; ino++)
+        CHECK(fs->write(fs, ino, 0, &files[0][ino]) == 0);
+    CHECK(fs->writev(fs, 13, 0, 20, files[0]) == 0);
+    CHECK(fs->sync(fs) == 0);
+
+    struct treedisk_superblock* sb = &((union treedisk_block*)disk)->superblock;
+    uint log_start = 1 + sb->n_inodeblocks + sb->n_bitmapblocks;
+    struct treedisk_logheader* header = (void*)&disk[log_start];
+    CHECK(header->nblocks > 0);
+    for (uint i = 0; i < header->nblocks; i++)
+        disk[header->home[i]] = saved[header->home[i]];
+
+    block_t block;
+    static block_t blocks[20];
+    fs = treedisk_init(&ramdisk, 0);
+    for (uint ino = 3; ino < 13; ino++) {
+        CHECK(fs->read(fs, ino, 0, &block) == 0);
+        CHECK(memcmp(&block, &files[0][ino], BLOCK_SIZE) == 0);
+    }
+    CHECK(fs->readv(fs, 13, 0, 20, blocks) == 0);
+    CHECK(memcmp(blocks, files[0], sizeof(blocks)) == 0);
+
+    /* A torn commit, with a logged block not written, is ignored. */
+    for (uint i = 0; i < header->nblocks; i++)
+        disk[header->home[i]] = saved[header->home[i]];
+    disk[log_start + 1].bytes[7] ^= 1;
+    fs = treedisk_init(&ramdisk, 0);
+    CHECK(fs->getsize(fs, 13) == 0);
+    CHECK(fs->getsize(fs, 1) == 100);
+    CHECK(fs->getsize(fs, 2) == 99);
+}
+
+static void check_stats(inode_intf cache, uint nhits, uint nmisses,
+                        uint nevicts) {
+    struct cache_stats stats;
+    cachedisk_get_stats(cache, &stats);
+    CHECK(stats.nhits == nhits);
+    CHECK(stats.nmisses == nmisses);
+    CHECK(stats.nevicts == nevicts);
+}
+
+static void test_cache() {
+    /* A cache of 4 blocks counts the hits and the misses, reads a run of
+     * missing blocks with one readv and evicts the least recently used
+     * block. */
+    printf("block cache\n");
+    inode_intf cache = cachedisk_init(&ramdisk, 4, 0);
+    for (uint off = 0; off < 8; off++) fill(&disk[off], off);
+
+    static block_t blocks[4];
+    nops = 0;
+    CHECK(cache->readv(cache, 0, 0, 4, blocks) == 0);
+    CHECK(memcmp(blocks, disk, sizeof(blocks)) == 0);
+    CHECK(nops == 1);
+    check_stats(cache, 0, 4, 0);
+
+    block_t block;
+    for (uint off = 0; off < 4; off++) {
+        CHECK(cache->read(cache, 0, off, &block) == 0);
+        CHECK(memcmp(&block, &disk[off], BLOCK_SIZE) == 0);
+    }
+    CHECK(nops == 1);
+    check_stats(cache, 4, 4, 0);
+
+    /* Block 1 is the least recently used after block 0 is read again. */
+    CHECK(cache->read(cache, 0, 0, &block) == 0);
+    CHECK(cache->read(cache, 0, 4, &block) == 0);
+    check_stats(cache, 5, 5, 1);
+    CHECK(cache->read(cache, 0, 0, &block) == 0);
+    CHECK(cache->read(cache, 0, 2, &block) == 0);
+    check_stats(cache, 7, 5, 1);
+    CHECK(cache->read(cache, 0, 1, &block) == 0);
+    CHECK(memcmp(&block, &disk[1], BLOCK_SIZE) == 0);
+    check_stats(cache, 7, 6, 2);
+
+    /* Shrinking a file drops its cached blocks beyond the new size. */
+    CHECK(cache->setsize(cache, 0, 1) == 0);
+    nops = 0;
+    CHECK(cache->read(cache, 0, 0, &block) == 0);
+    CHECK(nops == 0);
+    CHECK(cache->read(cache, 0, 1, &block) == 0);
+    CHECK(nops == 1);
+    check_stats(cache, 8, 7, 2);
+}
+
+static void test_write_back() {
+    /* The dirty blocks are written in runs of adjacent offsets, and stay
+     * dirty until their writev succeeds. */
+    printf("write-back cache\n");
+    memset(disk, 0, sizeof(disk));
+    inode_intf cache = cachedisk_init(&ramdisk, 4, 0);
+    for (uint off = 0; off < 8; off++) fill(&files[0][off], off);
+
+    nops = 0;
+    CHECK(cache->write(cache, 0, 6, &files[0][6]) == 0);
+    CHECK(cache->write(cache, 0, 4, &files[0][4]) == 0);
+    CHECK(cache->write(cache, 0, 5, &files[0][5]) == 0);
+    CHECK(cache->write(cache, 0, 1, &files[0][1]) == 0);
+    CHECK(nops == 0);
+
+    fail_writes = 1;
+    CHECK(cachedisk_sync(cache) == -1);
+    fail_writes = 0;
+    CHECK(cachedisk_sync(cache) == 0);
+    CHECK(nops == 2); /* block 1 and blocks 4 .. 6, sorted by offset */
+    for (uint off = 4; off < 7; off++)
+        CHECK(memcmp(&disk[off], &files[0][off], BLOCK_SIZE) == 0);
+    CHECK(memcmp(&disk[1], &files[0][1], BLOCK_SIZE) == 0);
+    nops = 0;
+    CHECK(cachedisk_sync(cache) == 0);
+    CHECK(nops == 0);
+
+    /* Evicting block 2 writes the dirty blocks 1 .. 3 next to it with one
+     * writev, and block 7 stays in the cache. */
+    memset(disk, 0, sizeof(disk));
+    CHECK(cache->write(cache, 0, 2, &files[0][2]) == 0);
+    CHECK(cache->write(cache, 0, 3, &files[0][3]) == 0);
+    CHECK(cache->write(cache, 0, 1, &files[0][1]) == 0);
+    CHECK(cache->write(cache, 0, 7, &files[0][7]) == 0);
+    block_t block;
+    nops = 0;
+    CHECK(cache->read(cache, 0, 0, &block) == 0);
+    CHECK(nops == 2);
+    CHECK(memcmp(&disk[1], &files[0][1], 3 * BLOCK_SIZE) == 0);
+    CHECK(disk[7].bytes[0] == 0);
+
+    struct cache_stats stats;
+    cachedisk_get_stats(cache, &stats);
+    CHECK(stats.nwrites == 8);
+    CHECK(stats.nwritebacks == 4 + 3);
+}
+
+/* The worker of GPID_FILE as a host thread: A disk operation of the worker
+ * waits until the dispatcher resumes it, and one of the dispatcher fails
+ * with would_block, like disk_io() in apps/system/sys_file.c. */
+static struct job_queue jobs;
+static struct job running;
+static ucontext_t dispatcher_ctx, worker_ctx;
+static char worker_stack[256 * 1024];
+static uint in_worker, would_block, waiting, busy, nchecks;
+
+static void worker_yield() {
+    in_worker = 0;
+    swapcontext(&worker_ctx, &dispatcher_ctx);
+}
+
+static void worker_resume() {
+    in_worker   = 1;
+    would_block = 0;
+    swapcontext(&dispatcher_ctx, &worker_ctx);
+}
+
+static int slow_readv(inode_intf bs, uint ino, uint offset, uint nblocks,
+                      block_t* blocks) {
+    if (!in_worker) {
+        would_block = 1;
+        return -1;
+    }
+    waiting = 1;
+    worker_yield();
+    return disk_readv(bs, ino, offset, nblocks, blocks);
+}
+
+static int slow_writev(inode_intf bs, uint ino, uint offset, uint nblocks,
+                       block_t* blocks) {
+    if (!in_worker) {
+        would_block = 1;
+        return -1;
+    }
+    CHECK(disk_writev(bs, ino, offset, nblocks, blocks) == 0);
+    waiting = 1;
+    worker_yield();
+    return 0;
+}
+
+static int slow_read(inode_intf bs, uint ino, uint offset, block_t* block) {
+    return slow_readv(bs, ino, offset, 1, block);
+}
+
+static int slow_write(inode_intf bs, uint ino, uint offset, block_t* block) {
+    return slow_writev(bs, ino, offset, 1, block);
+}
+
+static struct inode_store slowdisk = {.getsize = disk_getsize,
+                                      .setsize = disk_setsize,
+                                      .read    = slow_read,
+                                      .write   = slow_write,
+                                      .readv   = slow_readv,
+                                      .writev  = slow_writev};
+
+static inode_intf worker_fs;
+
+static int run(struct file_request* req) {
+    /* Serve req like serve() in sys_file, checking the blocks read. */
+    block_t block;
+    switch (req->type) {
+    case FILE_READ:
+        if (worker_fs->read(worker_fs, req->ino, req->offset, &block) < 0)
+            return -1;
+        CHECK(memcmp(&block, &files[req->ino][req->offset], BLOCK_SIZE) ==
+              0);
+        nchecks++;
+        return 0;
+    case FILE_WRITE:
+        CHECK(worker_fs->write(worker_fs, req->ino, req->offset,
+                               &req->block) == 0);
+        files[req->ino][req->offset] = req->block;
+        if (req->offset >= sizes[req->ino]) sizes[req->ino] = req->offset + 1;
+        return 0;
+    case FILE_SYNC:
+        CHECK(worker_fs->sync(worker_fs) == 0);
+        return 0;
+    default:
+        return FATAL("run: request %d", req->type);
+    }
+}
+
+static void worker_main() {
+    for (;;) {
+        while (job_pop(&jobs, &running) < 0) worker_yield();
+        busy = 1;
+        CHECK(run(&running.req) == 0);
+        busy = 0;
+    }
+}
+
+static void test_jobs() {
+    /* The job queue is FIFO, and a write to an inode holds back the reads
+     * of the inode and the path lookups only. */
+    printf("worker jobs\n");
+    struct file_request read = {.type = FILE_READ, .ino = 1};
+    struct file_request write = {.type = FILE_WRITE, .ino = 1};
+    struct file_request sync = {.type = FILE_SYNC};
+    struct file_request path = {.type = FILE_LOOKUP_PATH, .ino = 2};
+    struct job job = {.sender = 5, .req = write};
+
+    CHECK(job_serve_now(&read, NULL) && job_serve_now(&path, NULL));
+    CHECK(!job_serve_now(&write, NULL) && !job_serve_now(&sync, NULL));
+    CHECK(!job_serve_now(&read, &job) && !job_serve_now(&path, &job));
+    read.ino = 2;
+    CHECK(job_serve_now(&read, &job));
+    job.req = sync;
+    CHECK(job_serve_now(&read, &job) && job_serve_now(&path, &job));
+
+    for (uint i = 0; i < 3 * JOB_QUEUE_SIZE; i++) {
+        read.offset = i;
+        job_push(&jobs, i, &read);
+        CHECK(job_pop(&jobs, &job) == 0);
+        CHECK(job.sender == i && job.req.offset == i);
+    }
+    for (uint i = 0; i < JOB_QUEUE_SIZE; i++) job_push(&jobs, i, &read);
+    for (uint i = 0; i < JOB_QUEUE_SIZE; i++)
+        CHECK(job_pop(&jobs, &job) == 0 && job.sender == i);
+    CHECK(job_pop(&jobs, &job) == -1);
+
+    /* The dispatcher serves the reads which hit the cache while the worker
+     * waits for the disk in the middle of a write or a sync, and queues the
+     * others, as the main loop of sys_file does. */
+    uint nfiles = NFILES, nblocks = 40;
+    inode_intf fs = fs_create();
+    memset(files, 0, sizeof(files));
+    for (uint ino = 0; ino < nfiles; ino++) {
+        sizes[ino] = nblocks;
+        for (uint off = 0; off < nblocks; off++)
+            fill(&files[ino][off], ino * nblocks + off);
+        CHECK(fs->writev(fs, ino, 0, nblocks, files[ino]) == 0);
+    }
+    CHECK(fs->sync(fs) == 0);
+    worker_fs = treedisk_init(cachedisk_init(&slowdisk, 64, 0), 0);
+
+    getcontext(&worker_ctx);
+    worker_ctx.uc_stack.ss_sp   = worker_stack;
+    worker_ctx.uc_stack.ss_size = sizeof(worker_stack);
+    worker_ctx.uc_link          = NULL;
+    makecontext(&worker_ctx, worker_main, 0);
+
+    srand(2025);
+    uint nserved_busy = 0;
+    for (uint i = 0; i < 20000 || jobs.cnt > 0 || busy;) {
+        if (!waiting && jobs.cnt > 0) worker_resume();
+        if (waiting && (rand() % 2 || jobs.cnt == JOB_QUEUE_SIZE ||
+                        i >= 20000)) {
+            waiting = 0; /* the disk has served the worker */
+            worker_resume();
+            continue;
+        }
+        if (jobs.cnt == JOB_QUEUE_SIZE || i >= 20000) continue;
+
+        /* The writes also grow the files up to FILE_BLOCKS blocks. */
+        struct file_request req = {.ino = rand() % nfiles};
+        uint r   = rand() % 100;
+        req.type = (r < 10) ? FILE_WRITE : (r < 12) ? FILE_SYNC : FILE_READ;
+        req.offset = rand() % sizes[req.ino];
+        if (req.type == FILE_WRITE) {
+            req.offset = rand() % (sizes[req.ino] + 8);
+            if (req.offset >= FILE_BLOCKS) req.offset = FILE_BLOCKS - 1;
+            fill(&req.block, rand());
+        }
+        i++;
+
+        would_block = 0;
+        if (job_serve_now(&req, busy ? &running : NULL)) {
+            if (run(&req) == 0) {
+                nserved_busy += busy;
+                continue;
+            }
+            CHECK(would_block); /* a read which needs the disk */
+        }
+        job_push(&jobs, 5, &req);
+    }
+    CHECK(nserved_busy > 0);
+
+    /* Everything reaches the disk with the final sync. */
+    struct file_request final = {.type = FILE_SYNC};
+    job_push(&jobs, 5, &final);
+    do {
+        waiting = 0;
+        worker_resume();
+    } while (jobs.cnt > 0 || busy);
+    check_files(treedisk_init(&ramdisk, 0));
+    printf("%u reads checked, %u served while the worker was busy\n", nchecks,
+           nserved_busy);
+}
+
+int main() {
+    test_random_writes();
+    test_inode_cache();
+    test_sequential_file();
+    test_bitmap();
+    test_directory();
+    test_paths();
+    test_log();
+    test_cache();
+    test_write_back();
+    test_jobs();
+    printf("fstest: all tests passed\n");
+    return 0;
+}
@@ -23,7 +23,7 @@
 #include <dirent.h>
 #include <sys/stat.h>
 #include <sys/types.h>
-#include "inode.h"
+#include "dir.h"
 
 char* egos_binaries[] = {"./qemu/egos.bin",
                          "../build/release/sys_proc.elf",
@@ -33,7 +33,7 @@ char* egos_binaries[] = {"./qemu/egos.bin",
                          "./screenshots/Bohr.bmp" /* for the VGA demo */};
 #define EGOS_BIN_NUM ((sizeof(egos_binaries) / sizeof(char*)))
 
-char bin_dir[256] = "./   6 ../   0 ";
+char bin_dir[2048] = "./   6 ../   0 ";
 char* contents[]  = {
     "./   0 ../   0 home/   1 bin/   6 ",
     "./   1 ../   0 yunhao/   2 rvr/   3 yacqub/   4 ",
@@ -76,6 +76,40 @@ int ramwrite(inode_intf bs, uint ino, uint offset, block_t* block) {
     return 0;
 }
 
+int ramreadv(inode_intf bs, uint ino, uint offset, uint nblocks,
+             block_t* blocks) {
+    memcpy(blocks, fs + offset * BLOCK_SIZE, nblocks * BLOCK_SIZE);
+    return 0;
+}
+
+int ramwritev(inode_intf bs, uint ino, uint offset, uint nblocks,
+              block_t* blocks) {
+    memcpy(fs + offset * BLOCK_SIZE, blocks, nblocks * BLOCK_SIZE);
+    return 0;
+}
+
+int write_dir(inode_intf filesys, uint ino, char* text) {
+    /* Convert the "name ino" pairs in text to a hashed directory which
+     * is at most half full; See library/file/dir.h. */
+    char name[DIR_NAME_LEN];
+    uint nentries = 0, entry_ino;
+    int len;
+    for (char* p = text; sscanf(p, "%27s %u%n", name, &entry_ino, &len) == 2;
+         p += len)
+        nentries++;
+
+    uint nblocks = (nentries * 2 + DIR_ENTRIES_PER_BLOCK - 1) /
+                   DIR_ENTRIES_PER_BLOCK;
+    struct dir_block* blocks = calloc(nblocks, sizeof(struct dir_block));
+    for (char* p = text; sscanf(p, "%27s %u%n", name, &entry_ino, &len) == 2;
+         p += len)
+        assert(dir_insert(blocks, nblocks, name, entry_ino) == 0);
+
+    int ret = filesys->writev(filesys, ino, 0, nblocks, (void*)blocks);
+    free(blocks);
+    return ret;
+}
+
 int main() {
     /* Write the kernel and system server binaries into exec[]. */
     printf("[INFO] Load %ld kernel binary files\n", EGOS_BIN_NUM);
@@ -88,6 +122,8 @@ int main() {
     printf("MKFS is using *%s*\n", FILESYS == 0 ? "mydisk" : "treedisk");
     struct inode_store ramdisk = (struct inode_store){.read    = ramread,
                                                       .write   = ramwrite,
+                                                      .readv   = ramreadv,
+                                                      .writev  = ramwritev,
                                                       .getsize = getsize,
                                                       .setsize = setsize};
     (FILESYS == 0) ? assert(mydisk_create(&ramdisk, 0, NINODES) >= 0)
@@ -95,11 +131,16 @@ int main() {
     inode_intf filesys =
         (FILESYS == 0) ? mydisk_init(&ramdisk, 0) : treedisk_init(&ramdisk, 0);
 
-    /* Write to inode 0..BIN_DIR_INODE-1 in the file system. */
+    /* Write to inode 0..BIN_DIR_INODE-1 in the file system; The contents
+     * starting with "./" are directories. */
     for (uint ino = 0; ino < BIN_DIR_INODE; ino++) {
         printf("[INFO] Load ino=%d, %ld bytes\n", ino, strlen(contents[ino]));
-        strncpy(inode, contents[ino], BLOCK_SIZE);
-        filesys->write(filesys, ino, 0, (void*)inode);
+        if (strncmp(contents[ino], "./ ", 3) == 0) {
+            write_dir(filesys, ino, contents[ino]);
+        } else {
+            strncpy(inode, contents[ino], BLOCK_SIZE);
+            filesys->write(filesys, ino, 0, (void*)inode);
+        }
     }
 
     /* Write to one inode for each user application. */
@@ -114,9 +155,8 @@ int main() {
                    file_size);
 
             /* Write the ELF format application binary into inode app_ino. */
-            for (uint b = 0; b * BLOCK_SIZE < file_size; b++)
-                filesys->write(filesys, app_ino, b,
-                               (void*)(inode + b * BLOCK_SIZE));
+            uint nblocks = (file_size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+            filesys->writev(filesys, app_ino, 0, nblocks, (void*)inode);
 
             /* Add the corresponding file entry into the /bin directory. */
             ep->d_name[strlen(ep->d_name) - 4] = 0;
@@ -124,8 +164,9 @@ int main() {
             strcat(bin_dir, tmp);
         }
     closedir(dp);
-    filesys->write(filesys, BIN_DIR_INODE, 0, (void*)bin_dir);
+    write_dir(filesys, BIN_DIR_INODE, bin_dir);
     printf("[INFO] Load ino=%ld, %s\n", BIN_DIR_INODE, bin_dir);
+    assert(filesys->sync(filesys) >= 0);
 
     /* Generate the disk image file. */
     int fd    = open("disk.img", O_CREAT | O_WRONLY, 0666);